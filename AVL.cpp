@@ -0,0 +1,148 @@
+/**
+ * @file AVL.cpp
+ * @author Chek
+ * @brief AVL class implementation
+ *        This file is included by AVL.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "AVL.h"
+
+template <typename T, typename Compare>
+AVL<T, Compare>::AVL(SimpleAllocator* allocator, const Compare& compare)
+    : BST<T, Compare>(allocator, compare) {}
+
+template <typename T, typename Compare>
+AVL<T, Compare>::AVL(const SimpleAllocatorConfig& config, const Compare& compare)
+    : BST<T, Compare>(config, compare) {}
+
+template <typename T, typename Compare>
+template <typename ForwardIt>
+AVL<T, Compare>::AVL(ForwardIt first, ForwardIt last,
+                     SimpleAllocator* allocator, const Compare& compare)
+    : BST<T, Compare>(first, last, allocator, compare) {}
+
+template <typename T, typename Compare>
+std::pair<AVL<T, Compare>, AVL<T, Compare>> AVL<T, Compare>::split(const T& value) {
+    return this->template splitAs<AVL>(value);
+}
+
+template <typename T, typename Compare>
+AVL<T, Compare> AVL<T, Compare>::join(AVL&& lhs, AVL&& rhs) {
+    return BST<T, Compare>::joinAs(std::move(lhs), std::move(rhs));
+}
+
+template <typename T, typename Compare>
+void AVL<T, Compare>::updatePath(int) {
+    for (auto it = this->path_.rbegin(); it != this->path_.rend(); ++it)
+        balance(**it);
+}
+
+template <typename T, typename Compare>
+int AVL<T, Compare>::nodeHeight(BinTree tree) {
+    return tree == nullptr ? -1 : tree->height;
+}
+
+template <typename T, typename Compare>
+int AVL<T, Compare>::balanceFactor(BinTree tree) {
+    return nodeHeight(tree->right) - nodeHeight(tree->left);
+}
+
+template <typename T, typename Compare>
+void AVL<T, Compare>::updateNode(BinTree tree) {
+    int leftHeight = nodeHeight(tree->left);
+    int rightHeight = nodeHeight(tree->right);
+    tree->height = 1 + (leftHeight > rightHeight ? leftHeight : rightHeight);
+
+    unsigned leftCount = tree->left ? tree->left->count : 0;
+    unsigned rightCount = tree->right ? tree->right->count : 0;
+    tree->count = 1 + leftCount + rightCount;
+}
+
+template <typename T, typename Compare>
+void AVL<T, Compare>::rotateLeft(BinTree& tree) {
+    BinTree pivot = tree->right;
+    tree->right = pivot->left;
+    pivot->left = tree;
+
+    // the old root is now below the pivot so update it first
+    updateNode(tree);
+    updateNode(pivot);
+    tree = pivot;
+}
+
+template <typename T, typename Compare>
+void AVL<T, Compare>::rotateRight(BinTree& tree) {
+    BinTree pivot = tree->left;
+    tree->left = pivot->right;
+    pivot->right = tree;
+
+    // the old root is now below the pivot so update it first
+    updateNode(tree);
+    updateNode(pivot);
+    tree = pivot;
+}
+
+template <typename T, typename Compare>
+void AVL<T, Compare>::balance(BinTree& tree) {
+    updateNode(tree);
+
+    int bf = balanceFactor(tree);
+    if (bf < -1) {
+        // left heavy: a left-right case needs the left child rotated first
+        if (balanceFactor(tree->left) > 0)
+            rotateLeft(tree->left);
+        rotateRight(tree);
+    } else if (bf > 1) {
+        // right heavy: a right-left case needs the right child rotated first
+        if (balanceFactor(tree->right) < 0)
+            rotateRight(tree->right);
+        rotateLeft(tree);
+    }
+}
+
+template <typename T, typename Compare>
+typename AVL<T, Compare>::BinTree
+AVL<T, Compare>::joinNodes(BinTree left, BinTree node, BinTree right) {
+    if (nodeHeight(left) > nodeHeight(right) + 1)
+        return joinRight(left, node, right);
+    if (nodeHeight(right) > nodeHeight(left) + 1)
+        return joinLeft(left, node, right);
+
+    // close enough in height for the node to sit right on top
+    node->left = left;
+    node->right = right;
+    updateNode(node);
+    return node;
+}
+
+template <typename T, typename Compare>
+typename AVL<T, Compare>::BinTree
+AVL<T, Compare>::joinRight(BinTree left, BinTree node, BinTree right) {
+    if (nodeHeight(left) <= nodeHeight(right) + 1) {
+        node->left = left;
+        node->right = right;
+        updateNode(node);
+        return node;
+    }
+
+    // the joined subtree is at most one taller than the one it replaces,
+    // which one rotation (or two) at each node on the way back fixes
+    left->right = joinRight(left->right, node, right);
+    balance(left);
+    return left;
+}
+
+template <typename T, typename Compare>
+typename AVL<T, Compare>::BinTree
+AVL<T, Compare>::joinLeft(BinTree left, BinTree node, BinTree right) {
+    if (nodeHeight(right) <= nodeHeight(left) + 1) {
+        node->left = left;
+        node->right = right;
+        updateNode(node);
+        return node;
+    }
+
+    right->left = joinLeft(left, node, right->left);
+    balance(right);
+    return right;
+}
@@ -0,0 +1,164 @@
+/**
+ * @file AVL.h
+ * @author Chek
+ * @brief AVL class definition
+ *        A self-balancing BST that keeps its height at O(log n)
+ *        so that sorted input no longer degrades it into a linked list
+ * @date 12 Sep 2023
+ */
+#ifndef AVL_H
+#define AVL_H
+#include "BST.h"
+
+/**
+ * @class AVL
+ * @brief AVL tree class
+ *       It is a template class derived from BST
+ *       It overrides updatePath() so that every add, emplace and remove
+ *       rebalances the path walked bottom-up using rotations, where each
+ *       node caches its height and the balance factor is
+ *       height(right) - height(left)
+ *       The subtree counts are kept up to date so that operator[] works
+ * @tparam T The type of the values
+ * @tparam Compare The comparison function object (see BST)
+ */
+template <typename T, typename Compare = std::less<T>>
+class AVL : public BST<T, Compare> {
+  public:
+    typedef typename BST<T, Compare>::BinTreeNode BinTreeNode;
+    typedef typename BST<T, Compare>::BinTree BinTree;
+
+    /**
+     * @brief Default constructor
+     * @param allocator The allocator to be used
+     * @param compare The comparison function object to order the values
+     */
+    AVL(SimpleAllocator* allocator = nullptr,
+        const Compare& compare = Compare());
+
+    /**
+     * @brief Construct a tree that owns an allocator made with a config
+     *        (see BST::arenaConfig())
+     * @param config The configuration of the allocator
+     * @param compare The comparison function object to order the values
+     */
+    explicit AVL(const SimpleAllocatorConfig& config,
+                 const Compare& compare = Compare());
+
+    /**
+     * @brief Construct a height-optimal tree from a sorted range
+     *        (see BST::build(), a perfectly balanced tree is a valid AVL)
+     * @param first The start of the range of strictly increasing values
+     * @param last The end of the range
+     * @param allocator The allocator to be used
+     * @param compare The comparison function object to order the values
+     * @throw BSTException if the range is not strictly increasing
+     */
+    template <typename ForwardIt>
+    AVL(ForwardIt first, ForwardIt last, SimpleAllocator* allocator = nullptr,
+        const Compare& compare = Compare());
+
+    /**
+     * @brief Split the tree at a value in O(log n), moving its nodes into
+     *        two AVL trees (see BST::split())
+     * @param value The value to split at (it need not be in the tree)
+     * @return The tree of the values less than the value, and the tree of
+     *         the values not less than it
+     */
+    std::pair<AVL, AVL> split(const T& value);
+
+    /**
+     * @brief Join two AVL trees into one in O(log n) (see BST::join())
+     * @param lhs The tree of the smaller values
+     * @param rhs The tree of the larger values
+     * @return The joined tree
+     * @throw BSTException if a value of lhs is not less than every value
+     *        of rhs (the trees are left unchanged)
+     */
+    static AVL join(AVL&& lhs, AVL&& rhs);
+
+  protected:
+
+    /**
+     * @brief Rebalance the nodes on the path walked (BST::path_) bottom-up
+     *        after a node was added or removed below them
+     *        (updateNode() recomputes the counts, so delta is not needed)
+     * @param delta The change in size of the subtrees on the path
+     */
+    virtual void updatePath(int delta) override;
+
+    /**
+     * @brief Get the cached height of a tree
+     * @param tree The tree to be checked
+     * @return The height of the tree (-1 if empty)
+     */
+    static int nodeHeight(BinTree tree);
+
+    /**
+     * @brief Get the balance factor of a tree
+     * @param tree The tree to be checked
+     * @return height(right) - height(left)
+     */
+    static int balanceFactor(BinTree tree);
+
+    /**
+     * @brief Recompute the cached height and count of a node
+     *        from its children
+     * @param tree The node to be updated
+     */
+    static void updateNode(BinTree tree);
+
+    /**
+     * @brief Rotate the tree left, i.e., the right child becomes the root
+     * @param tree The tree to be rotated (updated to the new root)
+     */
+    static void rotateLeft(BinTree& tree);
+
+    /**
+     * @brief Rotate the tree right, i.e., the left child becomes the root
+     * @param tree The tree to be rotated (updated to the new root)
+     */
+    static void rotateRight(BinTree& tree);
+
+    /**
+     * @brief Restore the AVL property at the root of the tree
+     *        It assumes both subtrees are already balanced
+     * @param tree The tree to be balanced (updated to the new root)
+     */
+    static void balance(BinTree& tree);
+
+    /**
+     * @brief Make a node the root of two AVL trees, walking down the side
+     *        of the taller tree to a subtree of about the height of the
+     *        other one, so that it costs O(difference in heights)
+     * @param left The tree of the smaller values
+     * @param node The node to join them with
+     * @param right The tree of the larger values
+     * @return The root of the joined (balanced) tree
+     */
+    virtual BinTree joinNodes(BinTree left, BinTree node, BinTree right) override;
+
+    /**
+     * @brief Join where left is taller, down its right side
+     *        (each node on the way is rebalanced as the recursion returns)
+     * @param left The taller tree of the smaller values
+     * @param node The node to join them with
+     * @param right The tree of the larger values
+     * @return The root of the joined tree
+     */
+    static BinTree joinRight(BinTree left, BinTree node, BinTree right);
+
+    /**
+     * @brief Join where right is taller, down its left side
+     * @param left The tree of the smaller values
+     * @param node The node to join them with
+     * @param right The taller tree of the larger values
+     * @return The root of the joined tree
+     */
+    static BinTree joinLeft(BinTree left, BinTree node, BinTree right);
+};
+
+// include the implementation as AVL is a templated class (see BST.h)
+#include "AVL.cpp"
+
+#endif
@@ -1,2 +1,1251 @@
+/**
+ * @file BST.cpp
+ * @author Chek
+ * @brief BST class implementation
+ *        This file is included by BST.h as the class is templated
+ * @date 12 Sep 2023
+ */
 #include "BST.h"
-#include <iostream>
\ No newline at end of file
+#include <iostream>
+#include <exception>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+template <typename T, typename Compare>
+BST<T, Compare>::BST(SimpleAllocator* allocator, const Compare& compare)
+    : root_(nullptr), allocator_(allocator), ownAllocator_(),
+      compare_(compare) {
+    // create our own allocator if the client did not provide one
+    ensureAllocator();
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>::BST(const SimpleAllocatorConfig& config, const Compare& compare)
+    : root_(nullptr), allocator_(nullptr),
+      ownAllocator_(std::make_shared<SimpleAllocator>(sizeof(BinTreeNode), config)),
+      compare_(compare) {
+    allocator_ = ownAllocator_.get();
+}
+
+template <typename T, typename Compare>
+SimpleAllocatorConfig BST<T, Compare>::arenaConfig() {
+    return ownConfig(true);
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>::BST(const BST& rhs)
+    : BST(rhs, 1) {}
+
+template <typename T, typename Compare>
+BST<T, Compare>::BST(const BST& rhs, unsigned threads)
+    : root_(nullptr), allocator_(rhs.allocator_), ownAllocator_(),
+      compare_(rhs.compare_) {
+    // if rhs owns its allocator, then we need our own too
+    // - otherwise share the client-provided allocator
+    if (rhs.ownAllocator_ != nullptr) {
+        ownAllocator_ = std::make_shared<SimpleAllocator>(sizeof(BinTreeNode),
+                                                          rhs.allocator_->getConfig());
+        allocator_ = ownAllocator_.get();
+    }
+    ensureAllocator();
+
+    copy_(root_, rhs.root_, threads);
+}
+
+template <typename T, typename Compare>
+template <typename ForwardIt>
+BST<T, Compare>::BST(ForwardIt first, ForwardIt last,
+                     SimpleAllocator* allocator, const Compare& compare)
+    : BST(allocator, compare) {
+    build(first, last);
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>& BST<T, Compare>::operator=(const BST& rhs) {
+    assign(rhs, 1);
+    return *this;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::assign(const BST& rhs, unsigned threads) {
+    // check for self-assignment
+    if (this == &rhs)
+        return;
+
+    // free our nodes first and then copy over the rhs nodes
+    // - we keep using our own allocator
+    clear();
+    compare_ = rhs.compare_;
+    copy_(root_, rhs.root_, threads);
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>::BST(BST&& rhs) noexcept
+    : root_(rhs.root_), allocator_(rhs.allocator_),
+      ownAllocator_(std::move(rhs.ownAllocator_)), compare_(rhs.compare_) {
+    // rhs is left empty and without an allocator
+    rhs.root_ = nullptr;
+    rhs.allocator_ = nullptr;
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>& BST<T, Compare>::operator=(BST&& rhs) noexcept {
+    // our old nodes and allocator go into a temporary that frees them
+    BST old(std::move(rhs));
+    swap(old);
+    return *this;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::swap(BST& rhs) noexcept {
+    std::swap(root_, rhs.root_);
+    std::swap(allocator_, rhs.allocator_);
+    std::swap(ownAllocator_, rhs.ownAllocator_);
+    std::swap(compare_, rhs.compare_);
+}
+
+template <typename T, typename Compare>
+void swap(BST<T, Compare>& lhs, BST<T, Compare>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+template <typename T, typename Compare>
+BST<T, Compare>::~BST() {
+    // the allocator itself goes with the last tree that owns it
+    clear();
+}
+
+template <typename T, typename Compare>
+const typename BST<T, Compare>::BinTreeNode*
+BST<T, Compare>::operator[](int index) const {
+    // check the index before doing the traversal
+    if (index < 0 || static_cast<unsigned>(index) >= size())
+        throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+
+    return getNode_(root_, index);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::add(const T& value) noexcept(false) {
+    if (!add_(root_, value))
+        throw BSTException(BSTException::E_DUPLICATE,
+                           "Value to add already exists in the tree");
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::add(T&& value) noexcept(false) {
+    if (!add_(root_, std::move(value)))
+        throw BSTException(BSTException::E_DUPLICATE,
+                           "Value to add already exists in the tree");
+}
+
+template <typename T, typename Compare>
+template <typename... Args>
+void BST<T, Compare>::emplace(Args&&... args) {
+    linkNode(makeNode(std::in_place, std::forward<Args>(args)...));
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::remove(const T& value) {
+    if (!remove_(root_, value))
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+void BST<T, Compare>::remove(const K& key) {
+    if (!remove_(root_, key))
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::tryAdd(const T& value) {
+    return add_(root_, value);
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::tryAdd(T&& value) {
+    return add_(root_, std::move(value));
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::tryRemove(const T& value) {
+    return remove_(root_, value);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+bool BST<T, Compare>::tryRemove(const K& key) {
+    return remove_(root_, key);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::clear() {
+    clear_(root_);
+}
+
+template <typename T, typename Compare>
+std::pair<BST<T, Compare>, BST<T, Compare>> BST<T, Compare>::split(const T& value) {
+    return splitAs<BST>(value);
+}
+
+template <typename T, typename Compare>
+BST<T, Compare> BST<T, Compare>::join(BST&& lhs, BST&& rhs) {
+    return joinAs(std::move(lhs), std::move(rhs));
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::unionWith(const BST& other, unsigned threads) {
+    merge_(other, true, true, true, threads);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::intersectWith(const BST& other, unsigned threads) {
+    merge_(other, false, true, false, threads);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::subtract(const BST& other, unsigned threads) {
+    merge_(other, true, false, false, threads);
+}
+
+template <typename T, typename Compare>
+template <typename ForwardIt>
+void BST<T, Compare>::build(ForwardIt first, ForwardIt last) {
+    // check the whole range before touching the tree
+    unsigned n = 0;
+    for (ForwardIt it = first, prev = first; it != last; prev = it++, ++n) {
+        if (n == 0)
+            continue;
+        if (compare_(*it, *prev))
+            throw BSTException(BSTException::E_NOT_SORTED,
+                               "Values to build from are not sorted");
+        if (!compare_(*prev, *it))
+            throw BSTException(BSTException::E_DUPLICATE,
+                               "Values to build from contain a duplicate");
+    }
+
+    clear();
+
+    // allocate all the nodes in one go
+    std::vector<void*> blocks = allocateNodes_(n);
+    void** nextBlock = blocks.data();
+    try {
+        build_(first, n, nextBlock, root_);
+    } catch (...) {
+        // give back the blocks that did not get a node (the others are null)
+        // and then the nodes that were made, which are all linked in
+        allocator_->freeBatch(blocks.data(), n);
+        clear_(root_);
+        throw;
+    }
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::find(const T& value, unsigned& compares) const {
+    compares = 0;
+    return find_(root_, value, compares);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+bool BST<T, Compare>::find(const K& key, unsigned& compares) const {
+    compares = 0;
+    return find_(root_, key, compares);
+}
+
+template <typename T, typename Compare>
+unsigned BST<T, Compare>::rank(const T& value) const {
+    return rank_(root_, value, false);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+unsigned BST<T, Compare>::rank(const K& key) const {
+    return rank_(root_, key, false);
+}
+
+template <typename T, typename Compare>
+unsigned BST<T, Compare>::countInRange(const T& lo, const T& hi) const {
+    return countInRange_(root_, lo, hi);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+unsigned BST<T, Compare>::countInRange(const K& lo, const K& hi) const {
+    return countInRange_(root_, lo, hi);
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_iterator
+BST<T, Compare>::lowerBound(const T& value) const {
+    return bound_(root_, value, true);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+typename BST<T, Compare>::const_iterator
+BST<T, Compare>::lowerBound(const K& key) const {
+    return bound_(root_, key, true);
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_iterator
+BST<T, Compare>::upperBound(const T& value) const {
+    return bound_(root_, value, false);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+typename BST<T, Compare>::const_iterator
+BST<T, Compare>::upperBound(const K& key) const {
+    return bound_(root_, key, false);
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::empty() const {
+    return isEmpty(root_);
+}
+
+template <typename T, typename Compare>
+unsigned int BST<T, Compare>::size() const {
+    return size_(root_);
+}
+
+template <typename T, typename Compare>
+int BST<T, Compare>::height() const {
+    return height_(root_);
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::BinTree BST<T, Compare>::root() const {
+    return root_;
+}
+
+template <typename T, typename Compare>
+Compare BST<T, Compare>::comparator() const {
+    return compare_;
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_iterator BST<T, Compare>::begin() const {
+    const_iterator it(root_);
+    it.step(true);
+    return it;
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_iterator BST<T, Compare>::end() const {
+    return const_iterator(root_);
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_reverse_iterator
+BST<T, Compare>::rbegin() const {
+    const_reverse_iterator it(root_);
+    it.step(false);
+    return it;
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::const_reverse_iterator BST<T, Compare>::rend() const {
+    return const_reverse_iterator(root_);
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+BST<T, Compare>::Iterator<IsReverse>::Iterator(BinTree root)
+    : root_(root), path_() {}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>::reference
+BST<T, Compare>::Iterator<IsReverse>::operator*() const {
+    return path_.back()->data;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>::pointer
+BST<T, Compare>::Iterator<IsReverse>::operator->() const {
+    return &path_.back()->data;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>&
+BST<T, Compare>::Iterator<IsReverse>::operator++() {
+    step(!IsReverse);
+    return *this;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>
+BST<T, Compare>::Iterator<IsReverse>::operator++(int) {
+    Iterator old(*this);
+    step(!IsReverse);
+    return old;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>&
+BST<T, Compare>::Iterator<IsReverse>::operator--() {
+    step(IsReverse);
+    return *this;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::template Iterator<IsReverse>
+BST<T, Compare>::Iterator<IsReverse>::operator--(int) {
+    Iterator old(*this);
+    step(IsReverse);
+    return old;
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+bool BST<T, Compare>::Iterator<IsReverse>::operator==(
+    const Iterator& rhs) const {
+    return node() == rhs.node();
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+bool BST<T, Compare>::Iterator<IsReverse>::operator!=(
+    const Iterator& rhs) const {
+    return node() != rhs.node();
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+typename BST<T, Compare>::BinTree
+BST<T, Compare>::Iterator<IsReverse>::node() const {
+    return path_.empty() ? nullptr : path_.back();
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+void BST<T, Compare>::Iterator<IsReverse>::pushDown(BinTree node, bool goLeft) {
+    while (node != nullptr) {
+        path_.push_back(node);
+        node = goLeft ? node->left : node->right;
+    }
+}
+
+template <typename T, typename Compare>
+template <bool IsReverse>
+void BST<T, Compare>::Iterator<IsReverse>::step(bool toLarger) {
+    // from the end, start over at the smallest (or largest) value
+    if (path_.empty()) {
+        pushDown(root_, toLarger);
+        return;
+    }
+
+    // the next value is the extreme of the subtree on that side, if any
+    BinTree node = path_.back();
+    BinTree side = toLarger ? node->right : node->left;
+    if (side != nullptr) {
+        path_.push_back(side);
+        pushDown(toLarger ? side->left : side->right, toLarger);
+        return;
+    }
+
+    // otherwise go up until we come up from the other side of a parent
+    // - running out of parents means we have stepped off the end
+    do {
+        node = path_.back();
+        path_.pop_back();
+    } while (!path_.empty() &&
+             (toLarger ? path_.back()->right : path_.back()->left) == node);
+}
+
+template <typename T, typename Compare>
+template <typename... Args>
+typename BST<T, Compare>::BinTree BST<T, Compare>::makeNode(Args&&... args) {
+    ensureAllocator();
+
+    // get the raw memory from the allocator
+    void* mem = nullptr;
+    try {
+        mem = allocator_->allocate();
+    } catch (const SimpleAllocatorException& e) {
+        throw BSTException(BSTException::E_NO_MEMORY, e.what());
+    }
+
+    // and construct the node in place, giving the memory back if T throws
+    try {
+        BinTree node = new (mem) BinTreeNode(std::forward<Args>(args)...);
+        node->count = 1;
+        return node;
+    } catch (...) {
+        allocator_->free(mem);
+        throw;
+    }
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::linkNode(BinTree node) {
+    BinTree* link = findAddLink(root_, node->data);
+    if (*link != nullptr) {
+        freeNode(node);
+        throw BSTException(BSTException::E_DUPLICATE,
+                           "Value to add already exists in the tree");
+    }
+    *link = node;
+
+    // the subtrees on the path grew
+    updatePath(1);
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::BinTree
+BST<T, Compare>::joinNodes(BinTree left, BinTree node, BinTree right) {
+    node->left = left;
+    node->right = right;
+    node->count = 1 + size_(left) + size_(right);
+    return node;
+}
+
+template <typename T, typename Compare>
+template <typename Tree>
+std::pair<Tree, Tree> BST<T, Compare>::splitAs(const T& value) {
+    // both halves share our allocator, as our nodes are in it
+    ensureAllocator();
+    Tree lhs(allocator_, compare_);
+    Tree rhs(allocator_, compare_);
+    static_cast<BST&>(lhs).ownAllocator_ = ownAllocator_;
+    static_cast<BST&>(rhs).ownAllocator_ = ownAllocator_;
+
+    // walk down to the value (or the empty link where it would go)
+    path_.clear();
+    BinTree* link = &root_;
+    while (*link != nullptr) {
+        if (compare_(value, (*link)->data)) {
+            path_.push_back(link);
+            link = &(*link)->left;
+        } else if (compare_((*link)->data, value)) {
+            path_.push_back(link);
+            link = &(*link)->right;
+        } else
+            break;
+    }
+
+    // the node holding the value starts the upper half
+    BinTree lower = nullptr;
+    BinTree upper = nullptr;
+    if (*link != nullptr) {
+        lower = (*link)->left;
+        upper = joinNodes(nullptr, *link, (*link)->right);
+    }
+
+    // bottom-up, each node on the path takes the half built so far on its
+    // side and its other subtree goes with it to the other half
+    for (auto it = path_.rbegin(); it != path_.rend(); ++it) {
+        BinTree node = **it;
+        if (compare_(value, node->data))
+            upper = joinNodes(upper, node, node->right);
+        else
+            lower = joinNodes(node->left, node, lower);
+    }
+    root_ = nullptr;
+
+    static_cast<BST&>(lhs).root_ = lower;
+    static_cast<BST&>(rhs).root_ = upper;
+    return std::make_pair(std::move(lhs), std::move(rhs));
+}
+
+template <typename T, typename Compare>
+template <typename Tree>
+Tree BST<T, Compare>::joinAs(Tree&& lhs, Tree&& rhs) {
+    BST& left = lhs;
+    BST& right = rhs;
+    if (right.root_ == nullptr)
+        return std::move(lhs);
+    if (left.root_ == nullptr)
+        return std::move(rhs);
+
+    // the largest value on the left must be less than the smallest right
+    BinTree largest = left.root_;
+    while (largest->right != nullptr)
+        largest = largest->right;
+    BinTree smallest = right.root_;
+    while (smallest->left != nullptr)
+        smallest = smallest->left;
+    if (!left.compare_(largest->data, smallest->data))
+        throw BSTException(BSTException::E_NOT_SORTED,
+                           "Values to join overlap");
+
+    // nodes can only be relinked within one allocator, so copy the smaller
+    // tree into the other one's allocator (through a tree sharing it)
+    if (left.allocator_ != right.allocator_) {
+        bool isLeftSmaller = left.size() < right.size();
+        BST& from = isLeftSmaller ? left : right;
+        BST& into = isLeftSmaller ? right : left;
+        BST copy(into.allocator_, into.compare_);
+        copy.ownAllocator_ = into.ownAllocator_;
+        copy.copy_(copy.root_, from.root_, 1);
+
+        from.clear();
+        from.root_ = copy.root_;
+        from.allocator_ = into.allocator_;
+        from.ownAllocator_ = into.ownAllocator_;
+        copy.root_ = nullptr;
+        if (!isLeftSmaller) {
+            smallest = right.root_;
+            while (smallest->left != nullptr)
+                smallest = smallest->left;
+        }
+    }
+    if (left.ownAllocator_ == nullptr)
+        left.ownAllocator_ = right.ownAllocator_;
+
+    // unlink the smallest right node, fixing (or rebalancing) its path
+    right.path_.clear();
+    BinTree* link = &right.root_;
+    while ((*link)->left != nullptr) {
+        right.path_.push_back(link);
+        link = &(*link)->left;
+    }
+    *link = smallest->right;
+    right.updatePath(-1);
+
+    left.root_ = left.joinNodes(left.root_, smallest, right.root_);
+    right.root_ = nullptr;
+    return std::move(lhs);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::updatePath(int delta) {
+    for (BinTree* pathLink : path_)
+        (*pathLink)->count += delta;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::freeNode(BinTree node) {
+    // destroy the node explicitly as it was constructed with placement new
+    node->~BinTreeNode();
+    allocator_->free(node);
+}
+
+template <typename T, typename Compare>
+int BST<T, Compare>::treeHeight(BinTree tree) const {
+    return height_(tree);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::findPredecessor(BinTree tree,
+                                      BinTree& predecessor) const {
+    // the predecessor is the rightmost node in the left subtree
+    predecessor = tree->left;
+    while (predecessor->right != nullptr)
+        predecessor = predecessor->right;
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::isEmpty(BinTree& tree) const {
+    return tree == nullptr;
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::isEmpty(const BinTree& tree) const {
+    return tree == nullptr;
+}
+
+template <typename T, typename Compare>
+bool BST<T, Compare>::isLeaf(const BinTree& tree) const {
+    return tree->left == nullptr && tree->right == nullptr;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::ensureAllocator() {
+    if (allocator_ != nullptr)
+        return;
+
+    ownAllocator_ = std::make_shared<SimpleAllocator>(sizeof(BinTreeNode),
+                                                      ownConfig(false));
+    allocator_ = ownAllocator_.get();
+}
+
+template <typename T, typename Compare>
+SimpleAllocatorConfig BST<T, Compare>::ownConfig(bool isArena) {
+    // a node whose size divides a cache line is aligned to its size, so
+    // that no node straddles two lines and no memory is spent on it
+    size_t nodeSize = sizeof(BinTreeNode);
+    bool fitsLine = nodeSize <= BST_CACHE_LINE_SIZE && (nodeSize & (nodeSize - 1)) == 0;
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES,
+                                 SimpleAllocatorConfig::HeaderBlockInfo(),
+                                 fitsLine ? static_cast<unsigned>(nodeSize) : 0);
+    config.isArena = isArena;
+    return config;
+}
+
+template <typename T, typename Compare>
+std::vector<void*> BST<T, Compare>::allocateNodes_(unsigned n) {
+    ensureAllocator();
+
+    std::vector<void*> blocks(n);
+    try {
+        allocator_->allocateBatch(n, blocks.data());
+    } catch (const SimpleAllocatorException& e) {
+        throw BSTException(BSTException::E_NO_MEMORY, e.what());
+    }
+    return blocks;
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::BinTree*
+BST<T, Compare>::findAddLink(BinTree& tree, const T& value) {
+    path_.clear();
+
+    BinTree* link = &tree;
+    while (*link != nullptr) {
+        BinTree node = *link;
+        if (compare_(value, node->data)) {
+            path_.push_back(link);
+            link = &node->left;
+        } else if (compare_(node->data, value)) {
+            path_.push_back(link);
+            link = &node->right;
+        } else
+            break;
+    }
+
+    return link;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+bool BST<T, Compare>::unlinkValue(BinTree& tree, const K& value) {
+    path_.clear();
+
+    // walk down to the node holding the value
+    BinTree* link = &tree;
+    while (*link != nullptr) {
+        BinTree node = *link;
+        if (compare_(value, node->data)) {
+            path_.push_back(link);
+            link = &node->left;
+        } else if (compare_(node->data, value)) {
+            path_.push_back(link);
+            link = &node->right;
+        } else
+            break;
+    }
+
+    if (*link == nullptr)
+        return false;
+
+    // two children: replace with the predecessor
+    // and remove the predecessor's node from the left subtree instead
+    BinTree node = *link;
+    if (node->left != nullptr && node->right != nullptr) {
+        path_.push_back(link);
+        link = &node->left;
+        while ((*link)->right != nullptr) {
+            path_.push_back(link);
+            link = &(*link)->right;
+        }
+        // the predecessor's node is freed below so its value can be moved
+        node->data = std::move((*link)->data);
+        node = *link;
+    }
+
+    // the node has at most one child now, which takes its place
+    *link = node->left != nullptr ? node->left : node->right;
+    freeNode(node);
+    return true;
+}
+
+template <typename T, typename Compare>
+template <typename U>
+bool BST<T, Compare>::add_(BinTree& tree, U&& value) {
+    BinTree* link = findAddLink(tree, value);
+    if (*link != nullptr)
+        return false;
+    *link = makeNode(std::forward<U>(value));
+
+    // only reached if the node was made, so the subtrees on the path grew
+    updatePath(1);
+    return true;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+bool BST<T, Compare>::find_(const BinTree& tree, const K& value,
+                            unsigned& compares) const {
+    BinTree node = tree;
+    while (node != nullptr) {
+        ++compares;
+        if (compare_(value, node->data))
+            node = node->left;
+        else if (compare_(node->data, value))
+            node = node->right;
+        else
+            return true;
+    }
+
+    // reached the end without finding the value
+    return false;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+unsigned BST<T, Compare>::rank_(const BinTree& tree, const K& value,
+                                bool isInclusive) const {
+    unsigned rank = 0;
+    BinTree node = tree;
+    while (node != nullptr) {
+        // the node and its whole left subtree are below the value
+        // when the node is (isInclusive ? <= : <) the value
+        bool isBelow = isInclusive ? !compare_(value, node->data)
+                                   : compare_(node->data, value);
+        if (isBelow) {
+            rank += size_(node->left) + 1;
+            node = node->right;
+        } else
+            node = node->left;
+    }
+
+    return rank;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+unsigned BST<T, Compare>::countInRange_(const BinTree& tree, const K& lo,
+                                        const K& hi) const {
+    if (compare_(hi, lo))
+        return 0;
+
+    return rank_(tree, hi, true) - rank_(tree, lo, false);
+}
+
+template <typename T, typename Compare>
+template <typename K>
+typename BST<T, Compare>::const_iterator
+BST<T, Compare>::bound_(const BinTree& tree, const K& value,
+                        bool isInclusive) const {
+    // walk down like find, keeping the path for the iterator and
+    // remembering how deep the last node above the value was
+    const_iterator it(tree);
+    size_t boundDepth = 0;
+    BinTree node = tree;
+    while (node != nullptr) {
+        it.path_.push_back(node);
+        bool isAbove = isInclusive ? !compare_(node->data, value)
+                                   : compare_(value, node->data);
+        if (isAbove) {
+            boundDepth = it.path_.size();
+            node = node->left;
+        } else
+            node = node->right;
+    }
+
+    // everything below the last node above the value is below the value
+    // - no such node means the bound is the end
+    it.path_.resize(boundDepth);
+    return it;
+}
+
+template <typename T, typename Compare>
+const typename BST<T, Compare>::BinTree
+BST<T, Compare>::getNode_(const BinTree& tree, int index) const {
+    BinTree node = tree;
+    while (node != nullptr) {
+        // L is the number of nodes in the left subtree
+        int L = static_cast<int>(size_(node->left));
+        if (L > index)
+            node = node->left;
+        else if (L < index) {
+            index -= L + 1;
+            node = node->right;
+        } else
+            return node;
+    }
+
+    return nullptr;
+}
+
+template <typename T, typename Compare>
+unsigned BST<T, Compare>::size_(const BinTree& tree) const {
+    // the count caches the size of the subtree rooted at each node
+    return tree == nullptr ? 0 : tree->count;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+bool BST<T, Compare>::remove_(BinTree& tree, const K& value) {
+    if (!unlinkValue(tree, value))
+        return false;
+
+    // only reached if a node was freed, so the subtrees on the path shrank
+    updatePath(-1);
+    return true;
+}
+
+template <typename T, typename Compare>
+int BST<T, Compare>::height_(const BinTree& tree) const {
+    // an empty tree has a height of -1 so that a leaf has a height of 0
+    int height = -1;
+    if (tree == nullptr)
+        return height;
+
+    // depth-first walk down the left children, leaving the right children
+    // and their depths on the stack to be walked later
+    std::vector<std::pair<BinTree, int>> stack;
+    stack.push_back(std::make_pair(tree, 0));
+    while (!stack.empty()) {
+        BinTree node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        for (; node != nullptr; node = node->left, ++depth) {
+            if (depth > height)
+                height = depth;
+            if (node->right != nullptr)
+                stack.push_back(std::make_pair(node->right, depth + 1));
+        }
+    }
+
+    return height;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::copy_(BinTree& tree, const BinTree& rtree, unsigned threads) {
+    tree = nullptr;
+    if (rtree == nullptr)
+        return;
+
+    // the count of the root is the number of nodes to be copied
+    std::vector<void*> blocks = allocateNodes_(rtree->count);
+    try {
+        copyNodes_(rtree, &tree, blocks.data(), threads);
+    } catch (...) {
+        // give back the blocks that did not get a node (the others are null)
+        // and then the nodes that were made, which are all linked in
+        allocator_->freeBatch(blocks.data(), rtree->count);
+        clear_(tree);
+        throw;
+    }
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::copyNodes_(BinTree rtree, BinTree* link, void** blocks,
+                                 unsigned threads) {
+    // hand the subtrees to other threads while both are worth it
+    // - a small subtree is copied here and the big one keeps all the
+    //   threads, so a lopsided tree still spreads its big subtrees out
+    while (threads > 1 && rtree != nullptr && rtree->count >= BST_PARALLEL_CUTOFF) {
+        unsigned leftCount = rtree->left ? rtree->left->count : 0;
+        unsigned rightCount = rtree->count - leftCount - 1;
+        BinTree node = new (blocks[0]) BinTreeNode(rtree->data);
+        blocks[0] = nullptr;
+        node->count = rtree->count;
+        node->height = rtree->height;
+        *link = node;
+
+        BinTree source = rtree;
+        if (leftCount < BST_PARALLEL_CUTOFF || rightCount < BST_PARALLEL_CUTOFF) {
+            if (leftCount < rightCount) {
+                copyNodes_(source->left, &node->left, blocks + 1, 1);
+                rtree = source->right;
+                link = &node->right;
+                blocks += 1 + leftCount;
+            } else {
+                copyNodes_(source->right, &node->right, blocks + 1 + leftCount, 1);
+                rtree = source->left;
+                link = &node->left;
+                blocks += 1;
+            }
+            continue;
+        }
+
+        // share the threads out by the sizes of the subtrees
+        unsigned long long share = 1ull * threads * leftCount / (leftCount + rightCount);
+        unsigned leftThreads = share < 1 ? 1
+                             : share > threads - 1 ? threads - 1
+                             : static_cast<unsigned>(share);
+        forkJoin_(threads,
+                  [=]() { copyNodes_(source->left, &node->left, blocks + 1, leftThreads); },
+                  [=]() { copyNodes_(source->right, &node->right, blocks + 1 + leftCount,
+                                     threads - leftThreads); });
+        return;
+    }
+    if (rtree == nullptr)
+        return;
+
+    // pre-order walk, keeping the link each copy goes into on the stack
+    // - a copy is linked in as soon as it is made, so the tree is always
+    //   well formed and can be cleared if copying a value throws
+    // - the left children are copied straight away and the right ones
+    //   are left on the stack to be copied later
+    std::vector<std::pair<BinTree, BinTree*>> stack;
+    stack.push_back(std::make_pair(rtree, link));
+    while (!stack.empty()) {
+        BinTree source = stack.back().first;
+        link = stack.back().second;
+        stack.pop_back();
+
+        for (; source != nullptr; source = source->left) {
+            BinTree node = new (*blocks) BinTreeNode(source->data);
+            *blocks++ = nullptr;
+            node->count = source->count;
+            node->height = source->height;
+            *link = node;
+            link = &node->left;
+
+            if (source->right != nullptr)
+                stack.push_back(std::make_pair(source->right, &node->right));
+        }
+    }
+}
+
+template <typename T, typename Compare>
+template <typename ForwardIt>
+void BST<T, Compare>::build_(ForwardIt& it, unsigned n, void**& blocks, BinTree& tree) {
+    if (n == 0)
+        return;
+
+    // the left subtree takes the 1st half of the values, then this node
+    // takes the middle one, and the right subtree takes the rest
+    // - the left subtree hangs from the link until the node takes it over,
+    //   so the nodes made so far can be cleared if copying a value throws
+    unsigned leftCount = n / 2;
+    build_(it, leftCount, blocks, tree);
+
+    BinTree node = new (*blocks) BinTreeNode(*it);
+    *blocks++ = nullptr;
+    ++it;
+
+    node->left = tree;
+    tree = node;
+    build_(it, n - leftCount - 1, blocks, node->right);
+    node->count = n;
+
+    // the left subtree is never smaller than the right one
+    node->height = node->left ? node->left->height + 1 : 0;
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::merge_(const BST& other, bool isKeepingOurs,
+                             bool isKeepingBoth, bool isAddingTheirs,
+                             unsigned threads) {
+    // every value of a tree is in both when merging with itself
+    if (&other == this) {
+        if (!isKeepingBoth)
+            clear();
+        return;
+    }
+
+    // list both trees in order
+    std::vector<BinTree> ours(size_(root_));
+    std::vector<BinTree> theirs(size_(other.root_));
+    forkJoin_(threads,
+              [&]() { flatten_(root_, ours.data(), threads / 2); },
+              [&]() { flatten_(other.root_, theirs.data(), threads - threads / 2); });
+
+    // count the values that are only theirs, to allocate their nodes in
+    // one batch before changing anything
+    std::vector<void*> blocks;
+    if (isAddingTheirs) {
+        unsigned added = 0;
+        for (size_t i = 0, j = 0; j < theirs.size();) {
+            if (i == ours.size() || compare_(theirs[j]->data, ours[i]->data)) {
+                ++added;
+                ++j;
+            } else if (compare_(ours[i]->data, theirs[j]->data))
+                ++i;
+            else {
+                ++i;
+                ++j;
+            }
+        }
+        blocks = allocateNodes_(added);
+    }
+
+    // merge, keeping our nodes and making nodes for the values added
+    std::vector<BinTree> kept;
+    std::vector<BinTree> dropped;
+    kept.reserve(isAddingTheirs ? ours.size() + blocks.size() : ours.size());
+    size_t used = 0;
+    try {
+        size_t i = 0;
+        size_t j = 0;
+        while (i < ours.size() || j < theirs.size()) {
+            if (j == theirs.size() ||
+                (i < ours.size() && compare_(ours[i]->data, theirs[j]->data))) {
+                (isKeepingOurs ? kept : dropped).push_back(ours[i++]);
+            } else if (i == ours.size() || compare_(theirs[j]->data, ours[i]->data)) {
+                if (isAddingTheirs) {
+                    BinTree node = new (blocks[used]) BinTreeNode(theirs[j]->data);
+                    ++used;
+                    kept.push_back(node);
+                }
+                ++j;
+            } else {
+                (isKeepingBoth ? kept : dropped).push_back(ours[i++]);
+                ++j;
+            }
+        }
+    } catch (...) {
+        // our tree is untouched, so give back the new nodes and blocks
+        for (size_t k = 0; k < used; ++k)
+            static_cast<BinTree>(blocks[k])->~BinTreeNode();
+        allocator_->freeBatch(blocks.data(), static_cast<unsigned>(blocks.size()));
+        throw;
+    }
+
+    root_ = relink_(kept.data(), static_cast<unsigned>(kept.size()), threads);
+
+    // free the nodes that were left out
+    for (size_t k = 0; k < dropped.size(); k += BST_FREE_BATCH_SIZE) {
+        size_t left = dropped.size() - k;
+        unsigned n = left < BST_FREE_BATCH_SIZE ? static_cast<unsigned>(left)
+                                                : BST_FREE_BATCH_SIZE;
+        for (unsigned d = 0; d < n; ++d)
+            dropped[k + d]->~BinTreeNode();
+        allocator_->freeBatch(reinterpret_cast<void**>(dropped.data() + k), n);
+    }
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::flatten_(BinTree tree, BinTree* nodes, unsigned threads) {
+    if (tree == nullptr)
+        return;
+
+    // hand the left subtree to another thread while it is worth it
+    if (threads > 1 && tree->count >= BST_PARALLEL_CUTOFF) {
+        unsigned leftCount = tree->left ? tree->left->count : 0;
+        nodes[leftCount] = tree;
+        forkJoin_(threads,
+                  [=]() { flatten_(tree->left, nodes, threads / 2); },
+                  [=]() { flatten_(tree->right, nodes + leftCount + 1,
+                                   threads - threads / 2); });
+        return;
+    }
+
+    // in-order walk with an explicit stack of the nodes still to be listed
+    std::vector<BinTree> stack;
+    while (tree != nullptr || !stack.empty()) {
+        for (; tree != nullptr; tree = tree->left)
+            stack.push_back(tree);
+        tree = stack.back();
+        stack.pop_back();
+        *nodes++ = tree;
+        tree = tree->right;
+    }
+}
+
+template <typename T, typename Compare>
+typename BST<T, Compare>::BinTree
+BST<T, Compare>::relink_(BinTree* nodes, unsigned n, unsigned threads) {
+    if (n == 0)
+        return nullptr;
+
+    // the left subtree takes the 1st half of the nodes, as in build_()
+    unsigned leftCount = n / 2;
+    BinTree tree = nodes[leftCount];
+    if (threads > 1 && n >= BST_PARALLEL_CUTOFF) {
+        forkJoin_(threads,
+                  [=]() { tree->left = relink_(nodes, leftCount, threads / 2); },
+                  [=]() { tree->right = relink_(nodes + leftCount + 1, n - leftCount - 1,
+                                                threads - threads / 2); });
+    } else {
+        tree->left = relink_(nodes, leftCount, 1);
+        tree->right = relink_(nodes + leftCount + 1, n - leftCount - 1, 1);
+    }
+    tree->count = n;
+
+    // the left subtree is never smaller than the right one
+    tree->height = tree->left ? tree->left->height + 1 : 0;
+
+    return tree;
+}
+
+template <typename T, typename Compare>
+template <typename First, typename Second>
+void BST<T, Compare>::forkJoin_(unsigned threads, First first, Second second) {
+    std::thread worker;
+    std::exception_ptr error;
+    if (threads > 1) {
+        try {
+            worker = std::thread([&first, &error]() {
+                try {
+                    first();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            });
+        } catch (const std::system_error&) {
+            // no thread could be started, so both run here
+        }
+    }
+    if (!worker.joinable())
+        first();
+
+    // the worker is joined before anything is thrown, so it never outlives
+    // the nodes it works on
+    try {
+        second();
+    } catch (...) {
+        if (worker.joinable())
+            worker.join();
+        throw;
+    }
+    if (worker.joinable())
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+}
+
+template <typename T, typename Compare>
+void BST<T, Compare>::clear_(BinTree& tree) {
+    if (tree == nullptr)
+        return;
+
+    // an allocator owned by the tree alone only holds our nodes,
+    // so all its pages can be released in one go
+    bool isReleasingPages = ownAllocator_.use_count() == 1 &&
+                            !allocator_->getConfig().useCPPMemManager;
+    if (isReleasingPages && std::is_trivially_destructible<T>::value) {
+        tree = nullptr;
+        allocator_->freeAll();
+        return;
+    }
+
+    void* batch[BST_FREE_BATCH_SIZE];
+    unsigned batchSize = 0;
+    while (tree != nullptr) {
+        BinTree node = tree;
+        if (node->left != nullptr) {
+            // rotate the left child up so that the root has no left child
+            tree = node->left;
+            node->left = tree->right;
+            tree->right = node;
+        } else {
+            // no left child: destroy the root and carry on with its right
+            tree = node->right;
+            node->~BinTreeNode();
+            if (isReleasingPages)
+                continue;
+
+            batch[batchSize++] = node;
+            if (batchSize == BST_FREE_BATCH_SIZE) {
+                allocator_->freeBatch(batch, batchSize);
+                batchSize = 0;
+            }
+        }
+    }
+
+    if (isReleasingPages)
+        allocator_->freeAll();
+    else
+        allocator_->freeBatch(batch, batchSize);
+}
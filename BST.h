@@ -10,8 +10,31 @@
 #ifndef BST_H
 #define BST_H
 #include "SimpleAllocator.h" // to use your SimpleAllocator
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Defaults for the allocator that a BST creates when the client does not
+// provide one: nodes are pooled in pages and there is no limit on the pages
+static const unsigned BST_OBJECTS_PER_PAGE = 1024;
+static const unsigned BST_MAX_PAGES = 0;
+
+// The cache line size that the nodes of a BST's own allocator are kept within
+static const unsigned BST_CACHE_LINE_SIZE = 64;
+
+// The number of nodes given back to the allocator in one freeBatch() call
+// when a tree is cleared
+static const unsigned BST_FREE_BATCH_SIZE = 256;
+
+// The smallest subtree that the set operations and copies hand to another
+// thread
+static const unsigned BST_PARALLEL_CUTOFF = 1 << 16;
 
 /**
  * @class BSTException
@@ -25,7 +48,8 @@ class BSTException : public std::exception {
     BSTException(int ErrCode, const std::string& Message)
         : error_code_(ErrCode), message_(Message){};
 
-    enum BST_EXCEPTION { E_OUT_BOUNDS, E_DUPLICATE, E_NO_MEMORY, E_NOT_FOUND };
+    enum BST_EXCEPTION { E_OUT_BOUNDS, E_DUPLICATE, E_NO_MEMORY, E_NOT_FOUND,
+                         E_NOT_SORTED };
 
     virtual int code() const { return error_code_; }
     virtual const char* what() const throw() { return message_.c_str(); }
@@ -41,9 +65,16 @@ class BSTException : public std::exception {
  * @brief Binary Search Tree class
  *       It is a template class
  *       It is implemented using a linked structure
- *       It is not a balanced tree
+ *       It is not a balanced tree (see AVL.h for a balanced one)
+ *       The values are ordered by Compare, which must be a strict weak
+ *       ordering (two values are equivalent if neither is less)
+ * @tparam T The type of the values
+ * @tparam Compare The comparison function object (std::less<T> by default)
+ *                 If it is transparent (e.g., std::less<>), find(), remove()
+ *                 and the range queries also accept any key type that it can
+ *                 compare with T, without constructing a T to search with
  */
-template <typename T> 
+template <typename T, typename Compare = std::less<T>>
 class BST {
   public:
     /**
@@ -62,40 +93,215 @@ class BST {
         // cache the number of nodes in the subtree rooted at this node
         unsigned count;
 
-        // balance factor is used to determine if the tree is balanced
-        // TODO: this is a suggestion when you want to implement some form 
-        //       of balancing in order to improve the performance in the 
-        //       last test case, e.g., implementing AVL trees
-        //int balanceFactor;
+        // cache the height of the subtree rooted at this node
+        // - only maintained by balanced trees (see AVL.h), where the
+        //   balance factor is derived as height(right) - height(left)
+        // - a leaf has a height of 0
+        int height;
         
         // default constructor
+        // - the data is value-initialized so that any T works, not just numbers
         BinTreeNode()
-            : left(0), right(0), data(0), count(0)/*, balanceFactor(0)*/{};
+            : left(0), right(0), data(), count(0), height(0){};
 
         // constructor with data
         BinTreeNode(const T& value)
-            : left(0), right(0), data(value), count(0)/*, balanceFactor(0)*/{};
+            : left(0), right(0), data(value), count(0), height(0){};
+
+        // constructor with data to be moved in
+        BinTreeNode(T&& value)
+            : left(0), right(0), data(std::move(value)), count(0), height(0){};
+
+        // constructor with the args to construct the data in place
+        template <typename... Args>
+        BinTreeNode(std::in_place_t, Args&&... args)
+            : left(0), right(0), data(std::forward<Args>(args)...), count(0),
+              height(0){};
     };
     typedef BinTreeNode* BinTree; // BinTree is a pointer to BinTreeNode
 
+    /**
+     * @class Iterator
+     * @brief A bidirectional in-order iterator over the values in the tree
+     *        - it keeps the path from the root to the current node, so it
+     *          needs no parent pointers in the nodes and each step is O(1)
+     *          amortized, but it allocates when the path grows (up to the
+     *          height of the tree) or the iterator is copied
+     *        - the values are keys, so they cannot be changed through it
+     *        - an iterator with an empty path is the end (or rend)
+     *        - adding or removing values invalidates all iterators
+     * @tparam IsReverse true to walk from the largest value to the smallest
+     */
+    template <bool IsReverse>
+    class Iterator {
+      public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        /**
+         * @brief Construct an end iterator
+         * @param root The root of the tree to be walked
+         */
+        explicit Iterator(BinTree root = nullptr);
+
+        // access the value at the current node
+        reference operator*() const;
+        pointer operator->() const;
+
+        // step to the next value (prefix and postfix)
+        Iterator& operator++();
+        Iterator operator++(int);
+
+        // step to the previous value (prefix and postfix)
+        Iterator& operator--();
+        Iterator operator--(int);
+
+        // iterators are equal if they are at the same node (or both at the end)
+        bool operator==(const Iterator& rhs) const;
+        bool operator!=(const Iterator& rhs) const;
+
+        /**
+         * @brief Get the node at the current position
+         * @return The current node (nullptr at the end)
+         */
+        BinTree node() const;
+
+      private:
+        friend class BST;
+
+        // the root of the tree, needed to step back from the end
+        BinTree root_;
+
+        // the nodes from the root down to the current node
+        std::vector<BinTree> path_;
+
+        /**
+         * @brief Push a node and then all of its left (or right) children
+         * @param node The node to start from
+         * @param goLeft true to follow the left children
+         */
+        void pushDown(BinTree node, bool goLeft);
+
+        /**
+         * @brief Step to the next larger (or smaller) value
+         *        Stepping from the end goes to the smallest (or largest)
+         * @param toLarger true to step to the next larger value
+         */
+        void step(bool toLarger);
+    };
+    typedef Iterator<false> const_iterator;
+    typedef const_iterator iterator;
+    typedef Iterator<true> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
     /**
      * @brief Default constructor
      * @param allocator The allocator to be used
+     * @param compare The comparison function object to order the values
+     */
+    BST(SimpleAllocator* allocator = nullptr,
+        const Compare& compare = Compare());
+
+    /**
+     * @brief Construct a tree that owns an allocator made with a config,
+     *        e.g., arenaConfig()
+     * @param config The configuration of the allocator
+     * @param compare The comparison function object to order the values
+     * @throw SimpleAllocatorException if the config is invalid
      */
-    BST(SimpleAllocator* allocator = nullptr);
+    explicit BST(const SimpleAllocatorConfig& config,
+                 const Compare& compare = Compare());
+
+    /**
+     * @brief Get the config of an arena allocator for the nodes
+     *        A tree that owns one hands out its nodes in order from its
+     *        pages, and clear() and the destructor release the pages
+     *        without walking the tree when T is trivially destructible
+     *        (clear() keeps the pages for the next values)
+     *        Removed nodes are only reused after clear()
+     * @return The config
+     */
+    static SimpleAllocatorConfig arenaConfig();
 
     /**
      * @brief Copy constructor
+     *        It copies on the calling thread alone, as T's copy constructor
+     *        need not be thread safe (see the copy constructor below to
+     *        copy with more threads)
      * @param rhs The BST to be copied
      */
     BST(const BST& rhs);
 
+    /**
+     * @brief Copy constructor with a given number of threads
+     *        The nodes are allocated in one batch and subtrees of at least
+     *        BST_PARALLEL_CUTOFF nodes are copied on their own threads,
+     *        which are shared out by the cached counts of the subtrees
+     * @param rhs The BST to be copied
+     * @param threads The number of threads to copy with (T's copy
+     *                constructor must be thread safe for more than one)
+     */
+    BST(const BST& rhs, unsigned threads);
+
+    /**
+     * @brief Construct a height-optimal tree from a sorted range
+     *        It calls build() to do the actual construction
+     * @param first The start of the range of strictly increasing values
+     * @param last The end of the range
+     * @param allocator The allocator to be used
+     * @param compare The comparison function object to order the values
+     * @throw BSTException if the range is not strictly increasing
+     */
+    template <typename ForwardIt>
+    BST(ForwardIt first, ForwardIt last, SimpleAllocator* allocator = nullptr,
+        const Compare& compare = Compare());
+
     /**
      * @brief Assignment operator
+     *        It copies on the calling thread alone (see assign() to copy
+     *        with more threads)
      * @param rhs The BST to be copied
      */
     BST& operator=(const BST& rhs);
 
+    /**
+     * @brief Replace the values with a copy of another tree's values
+     *        with a given number of threads (see the copy constructor)
+     *        We keep using our own allocator
+     * @param rhs The BST to be copied
+     * @param threads The number of threads to copy with (T's copy
+     *                constructor must be thread safe for more than one)
+     */
+    void assign(const BST& rhs, unsigned threads);
+
+    /**
+     * @brief Move constructor
+     *        It takes over the nodes and the allocator (and its ownership)
+     *        of rhs in O(1), leaving rhs as an empty tree
+     *        An empty tree without an allocator creates its own allocator
+     *        the next time it needs a node
+     * @param rhs The BST to be moved from
+     */
+    BST(BST&& rhs) noexcept;
+
+    /**
+     * @brief Move assignment operator
+     *        It takes over the nodes and the allocator of rhs in O(1),
+     *        while our old nodes are freed through our old allocator
+     * @param rhs The BST to be moved from
+     */
+    BST& operator=(BST&& rhs) noexcept;
+
+    /**
+     * @brief Swap the nodes and the allocators of two trees in O(1)
+     *        Only swap trees of the same kind (e.g., an AVL with an AVL)
+     * @param rhs The BST to be swapped with
+     */
+    void swap(BST& rhs) noexcept;
+
     /**
      * @brief Destructor
      *        It calls clear() to free all nodes
@@ -123,6 +329,27 @@ class BST {
      */
     virtual void add(const T& value) noexcept(false);
 
+    /**
+     * @brief Insert a value into the tree by moving it into the new node
+     *        It is virtual so that any derived class knows to override it
+     * @param value The value to be added (left as is if it is a duplicate)
+     * @throw BSTException if the value already exists
+     */
+    virtual void add(T&& value) noexcept(false);
+
+    /**
+     * @brief Insert a value constructed in place inside the new node
+     *        from the given args, so no temporary T is made
+     *        As the value only exists once the node is made, a duplicate
+     *        costs a node that is freed again straight away
+     *        The node is linked by linkNode(), which calls updatePath(),
+     *        so derived (balanced) trees rebalance after it as for add()
+     * @param args The args to be forwarded to the constructor of T
+     * @throw BSTException if the value already exists
+     */
+    template <typename... Args>
+    void emplace(Args&&... args);
+
     /**
      * @brief Remove a value from the tree
      *        It calls remove_() to do the actual recursive removal
@@ -132,11 +359,135 @@ class BST {
      */
     virtual void remove(const T& value);
 
+    /**
+     * @brief Remove the value equivalent to a key of another type
+     *        Only available when Compare is transparent
+     * @param key The key of the value to be removed
+     * @throw BSTException if no value is equivalent to the key
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    void remove(const K& key);
+
+    /**
+     * @brief Insert a value into the tree unless it already exists
+     *        Unlike add(), a duplicate is reported by the return value, so
+     *        nothing is thrown or allocated when the value is found
+     * @param value The value to be added
+     * @return true if the value was added, false if it already exists
+     */
+    bool tryAdd(const T& value);
+
+    /**
+     * @brief Insert a value into the tree by moving it into the new node
+     *        unless it already exists
+     * @param value The value to be added (left as is if it is a duplicate)
+     * @return true if the value was added, false if it already exists
+     */
+    bool tryAdd(T&& value);
+
+    /**
+     * @brief Remove a value from the tree if it exists
+     *        Unlike remove(), a miss is reported by the return value, so
+     *        nothing is thrown or allocated when the value is not found
+     * @param value The value to be removed
+     * @return true if the value was removed, false if it does not exist
+     */
+    bool tryRemove(const T& value);
+
+    /**
+     * @brief Remove the value equivalent to a key of another type if it
+     *        exists
+     *        Only available when Compare is transparent
+     * @param key The key of the value to be removed
+     * @return true if the value was removed, false if none is equivalent
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    bool tryRemove(const K& key);
+
     /**
      * @brief Remove all nodes in the tree
      */
     void clear();
 
+    /**
+     * @brief Split the tree at a value in O(height), moving its nodes into
+     *        two trees without allocating or freeing any, and leaving this
+     *        tree empty
+     *        The two trees share this tree's allocator (and its ownership),
+     *        so they may only be used on different threads at once if the
+     *        allocator is thread safe (useThreadCache), which the one a
+     *        tree creates by default is not
+     * @param value The value to split at (it need not be in the tree)
+     * @return The tree of the values less than the value, and the tree of
+     *         the values not less than it
+     */
+    std::pair<BST, BST> split(const T& value);
+
+    /**
+     * @brief Join two trees into one in O(height), where every value of
+     *        lhs is less than every value of rhs, leaving both empty
+     *        The nodes are relinked when the trees share an allocator (as
+     *        after split()), otherwise the smaller tree is copied into the
+     *        allocator of the other one first
+     *        The joined tree shares the allocator of the trees, so the same
+     *        thread safety rule holds as for split()
+     * @param lhs The tree of the smaller values
+     * @param rhs The tree of the larger values
+     * @return The joined tree
+     * @throw BSTException if a value of lhs is not less than every value
+     *        of rhs (the trees are left unchanged)
+     */
+    static BST join(BST&& lhs, BST&& rhs);
+
+    /**
+     * @brief Add every value of another tree that is not in this one,
+     *        without throwing on the values in both
+     *        Both trees are walked in order and merged in O(n + m), and the
+     *        result is relinked into a height-optimal tree (a valid AVL too)
+     *        - our nodes are reused and only the added values get new nodes,
+     *          which are allocated up front in one batch
+     * @param other The tree whose values are added (it is not changed)
+     * @param threads The number of threads that walk and relink the trees
+     *                (only subtrees of BST_PARALLEL_CUTOFF nodes are split)
+     * @throw BSTException if there is not enough memory (the tree is left
+     *        unchanged, as it is if copying a value throws)
+     */
+    void unionWith(const BST& other, unsigned threads = 1);
+
+    /**
+     * @brief Remove every value that is not in another tree
+     *        (see unionWith(), the removed nodes are freed in batches)
+     * @param other The tree of the values to be kept
+     * @param threads The number of threads that walk and relink the trees
+     */
+    void intersectWith(const BST& other, unsigned threads = 1);
+
+    /**
+     * @brief Remove every value that is in another tree
+     *        (see unionWith(), the removed nodes are freed in batches)
+     * @param other The tree of the values to be removed
+     * @param threads The number of threads that walk and relink the trees
+     */
+    void subtract(const BST& other, unsigned threads = 1);
+
+    /**
+     * @brief Replace the contents with a height-optimal tree built from
+     *        a sorted range in O(n), instead of n calls to add()
+     *        - all nodes are allocated up front in one batch
+     *        - the counts (and heights) are filled in as the tree is built
+     *        - the result is also a valid AVL tree
+     * @param first The start of the range of strictly increasing values
+     * @param last The end of the range
+     * @throw BSTException if the range is not strictly increasing
+     *        (the tree is left unchanged)
+     *        Anything T's copy constructor throws is passed on, after the
+     *        nodes already made are freed (the tree is left empty)
+     */
+    template <typename ForwardIt>
+    void build(ForwardIt first, ForwardIt last);
+
     /**
      * @brief Find a value in the tree
      *        It calls find_() to do the actual recursive search
@@ -148,6 +499,92 @@ class BST {
      */
     bool find(const T& value, unsigned& compares) const;
 
+    /**
+     * @brief Find a value equivalent to a key of another type
+     *        (e.g., a const char* or std::string_view for std::string values)
+     *        Only available when Compare is transparent
+     * @param key The key to be found
+     * @param compares The number of comparisons made
+     * @return true if a value equivalent to the key is found
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    bool find(const K& key, unsigned& compares) const;
+
+    /**
+     * @brief Get the number of values less than a value
+     *        This is the inverse of operator[] (select), i.e., if the value
+     *        is in the tree then tree[tree.rank(value)] holds it
+     *        It uses the cached counts so it is O(height)
+     * @param value The value to be ranked (it need not be in the tree)
+     * @return The number of values less than the value
+     */
+    unsigned rank(const T& value) const;
+
+    /**
+     * @brief Get the number of values less than a key of another type
+     *        Only available when Compare is transparent
+     * @param key The key to be ranked
+     * @return The number of values less than the key
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    unsigned rank(const K& key) const;
+
+    /**
+     * @brief Count the values in a closed range in O(height)
+     * @param lo The smallest value to be counted
+     * @param hi The largest value to be counted
+     * @return The number of values v where lo <= v <= hi
+     *         (0 if hi < lo)
+     */
+    unsigned countInRange(const T& lo, const T& hi) const;
+
+    /**
+     * @brief Count the values in a closed range of keys of another type
+     *        Only available when Compare is transparent
+     * @param lo The smallest key to be counted
+     * @param hi The largest key to be counted
+     * @return The number of values v where lo <= v <= hi
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    unsigned countInRange(const K& lo, const K& hi) const;
+
+    /**
+     * @brief Get an iterator to the first value not less than a value
+     * @param value The value to be compared with
+     * @return The iterator (end() if all values are less)
+     */
+    const_iterator lowerBound(const T& value) const;
+
+    /**
+     * @brief Get an iterator to the first value not less than a key
+     *        of another type (only available when Compare is transparent)
+     * @param key The key to be compared with
+     * @return The iterator (end() if all values are less)
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    const_iterator lowerBound(const K& key) const;
+
+    /**
+     * @brief Get an iterator to the first value greater than a value
+     * @param value The value to be compared with
+     * @return The iterator (end() if no value is greater)
+     */
+    const_iterator upperBound(const T& value) const;
+
+    /**
+     * @brief Get an iterator to the first value greater than a key
+     *        of another type (only available when Compare is transparent)
+     * @param key The key to be compared with
+     * @return The iterator (end() if no value is greater)
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    const_iterator upperBound(const K& key) const;
+
     /**
      * @brief Check if the tree is empty
      * @return true if the tree is empty
@@ -174,13 +611,61 @@ class BST {
      */
     BinTree root() const;
 
+    /**
+     * @brief Get the comparison function object that orders the values
+     * @return A copy of the comparison function object
+     */
+    Compare comparator() const;
+
+    /**
+     * @brief Get an iterator to the smallest value
+     *        (so that range-based for loops walk the values in order)
+     * @return The iterator (end() if the tree is empty)
+     */
+    const_iterator begin() const;
+
+    /**
+     * @brief Get the iterator past the largest value
+     * @return The end iterator
+     */
+    const_iterator end() const;
+
+    /**
+     * @brief Get a reverse iterator to the largest value
+     * @return The reverse iterator (rend() if the tree is empty)
+     */
+    const_reverse_iterator rbegin() const;
+
+    /**
+     * @brief Get the reverse iterator past the smallest value
+     * @return The reverse end iterator
+     */
+    const_reverse_iterator rend() const;
+
   protected:
 
     /**
      * @brief Allocate a new node
-     * @param value The value to be stored in the new node
+     * @param args The value to be stored in the new node, or the args to
+     *             construct it in place inside the node
      */
-    BinTree makeNode(const T& value);
+    template <typename... Args>
+    BinTree makeNode(Args&&... args);
+
+    /**
+     * @brief Link a node made by emplace() into the tree
+     * @param node The node to be linked (freed if its value is a duplicate)
+     * @throw BSTException if the value already exists
+     */
+    void linkNode(BinTree node);
+
+    /**
+     * @brief Update the nodes on the path walked (path_) after a node was
+     *        added or removed below them, which adjusts their counts
+     *        It is virtual so that balanced trees can rebalance it instead
+     * @param delta The change in size of the subtrees on the path (1 or -1)
+     */
+    virtual void updatePath(int delta);
 
     /**
      * @brief Free a node
@@ -218,37 +703,164 @@ class BST {
      */
     bool isLeaf(const BinTree& tree) const;
 
+    /**
+     * @brief Walk down to the empty link where a value is to be added
+     *        The links to the nodes walked past are recorded in path_
+     *        (top-down) so that the caller can fix their counts after
+     * @param tree The tree to be walked
+     * @param value The value to be added
+     * @return The empty link to put the new node in, or the link to the
+     *         node already holding the value (so that callers can decide
+     *         whether a duplicate is an error)
+     */
+    BinTree* findAddLink(BinTree& tree, const T& value);
+
+    /**
+     * @brief Unlink and free the node holding a value
+     *        A node with two children takes its predecessor's value and
+     *        the predecessor's node is freed instead
+     *        The links to the nodes above the freed one are recorded in
+     *        path_ (top-down) so that the caller can fix their counts after
+     * @param tree The tree to be walked
+     * @param value The value (or key equivalent to it) to be removed
+     * @return true if a node was freed, false if the value does not exist
+     */
+    template <typename K>
+    bool unlinkValue(BinTree& tree, const K& value);
+
+    /**
+     * @brief Make a node the root of two trees, where every value of left
+     *        is less than its value and every value of right greater
+     *        It is virtual so that balanced trees can rebalance the result
+     *        when the trees differ in height
+     * @param left The tree of the smaller values
+     * @param node The node to join them with
+     * @param right The tree of the larger values
+     * @return The root of the joined tree
+     */
+    virtual BinTree joinNodes(BinTree left, BinTree node, BinTree right);
+
+    /**
+     * @brief Split the tree into two trees of a given kind (see split())
+     *        The nodes on the path to the value are joined bottom-up into
+     *        the side they belong to with joinNodes()
+     * @tparam Tree The kind of tree to return (the kind of this tree)
+     * @param value The value to split at
+     * @return The trees of the values less than and not less than it
+     */
+    template <typename Tree>
+    std::pair<Tree, Tree> splitAs(const T& value);
+
+    /**
+     * @brief Join two trees of a given kind (see join())
+     *        The smallest node of rhs is unlinked (updating its path) and
+     *        joined with both trees with joinNodes()
+     * @tparam Tree The kind of the trees
+     * @param lhs The tree of the smaller values
+     * @param rhs The tree of the larger values
+     * @return The joined tree
+     */
+    template <typename Tree>
+    static Tree joinAs(Tree&& lhs, Tree&& rhs);
+
+    // the root of the tree
+    // - protected so that derived (balanced) trees can restructure it
+    BinTree root_;
+
+    // the links walked by the last add or remove (see findAddLink())
+    // - kept as a member so that its storage is reused between calls
+    std::vector<BinTree*> path_;
+
   private:
 
     // the allocator to be used
     SimpleAllocator* allocator_;
 
-    // whether the allocator is owned by the tree
-    bool isOwnAllocator_ = false;
+    // the allocator when it is owned by the tree (null for a client one)
+    // - shared with the trees split off from or joined with this one, as
+    //   their nodes live in it too
+    std::shared_ptr<SimpleAllocator> ownAllocator_;
 
-    // the root of the tree
-    BinTree root_;
+    // orders the values, i.e., compare_(a, b) is true if a goes before b
+    Compare compare_;
+
+    /**
+     * @brief Create an allocator owned by the tree if it has none
+     *        (i.e., after it has been moved from)
+     */
+    void ensureAllocator();
+
+    /**
+     * @brief Get the config of the allocator that a tree makes for itself
+     * @param isArena true for an arena (see arenaConfig())
+     * @return The config
+     */
+    static SimpleAllocatorConfig ownConfig(bool isArena);
 
     /**
-     * @brief A recursive step to add a value into the tree
+     * @brief Allocate the blocks for a number of nodes in one batch
+     * @param n The number of blocks to be allocated
+     * @return The blocks (the nodes are not constructed yet)
+     * @throw BSTException if there is not enough memory (nothing is allocated)
+     */
+    std::vector<void*> allocateNodes_(unsigned n);
+
+    /**
+     * @brief An iterative step to add a value into the tree
+     *        The counts on the path are only updated once the node is added
      * @param tree The tree to be added
-     * @param value The value to be added
+     * @param value The value to be added (copied or moved into the node)
+     * @return true if the value was added, false if it already exists
      */
-    void add_(BinTree& tree, const T& value);
+    template <typename U>
+    bool add_(BinTree& tree, U&& value);
 
     /**
-     * @brief A recursive step to find the value in the tree
+     * @brief An iterative step to find the value in the tree
      * @param tree The tree to be searched
-     * @param value The value to be found
+     * @param value The value (or key equivalent to it) to be found
      * @param compares The number of comparisons made
      *                (a reference to provide as output)
      *                Note that it is not const as it is used to provide output
      * @return true if the value is found
      */
-    bool find_(const BinTree& tree, const T& value, unsigned& compares) const;
+    template <typename K>
+    bool find_(const BinTree& tree, const K& value, unsigned& compares) const;
 
     /**
-     * @brief A recursive step to get to the node at the specified index
+     * @brief An iterative step to count the values below a value
+     * @param tree The tree to be searched
+     * @param value The value to be compared with
+     * @param isInclusive true to also count a value equal to it
+     * @return The number of values less than (or equal to) the value
+     */
+    template <typename K>
+    unsigned rank_(const BinTree& tree, const K& value, bool isInclusive) const;
+
+    /**
+     * @brief A step to count the values in a closed range from two ranks
+     * @param tree The tree to be searched
+     * @param lo The smallest value to be counted
+     * @param hi The largest value to be counted
+     * @return The number of values v where lo <= v <= hi (0 if hi < lo)
+     */
+    template <typename K>
+    unsigned countInRange_(const BinTree& tree, const K& lo, const K& hi) const;
+
+    /**
+     * @brief An iterative step to find the first value above a value
+     * @param tree The tree to be searched
+     * @param value The value to be compared with
+     * @param isInclusive true to also accept a value equal to it
+     * @return The iterator to the first value not less than (or greater
+     *         than) the value, or the end
+     */
+    template <typename K>
+    const_iterator bound_(const BinTree& tree, const K& value,
+                          bool isInclusive) const;
+
+    /**
+     * @brief An iterative step to get to the node at the specified index
      *        This is used by operator[]
      * @param tree The tree to be traversed
      * @param index The index of the node to be returned
@@ -258,34 +870,133 @@ class BST {
      const BinTree getNode_(const BinTree& tree, int index) const;
 
     /**
-     * @brief A recursive step to calculate the size of the tree
+     * @brief A step to get the size of the tree from its cached count
      * @param tree The tree to be calculated
      * @return The size of the tree
      */
     unsigned size_(const BinTree& tree) const;
 
     /**
-     * @brief A recursive step to remove a value from the tree
+     * @brief An iterative step to remove a value from the tree
+     *        The counts on the path are only updated once the node is freed
      * @param tree The tree to be removed
-     * @param value The value to be removed
+     * @param value The value (or key equivalent to it) to be removed
+     * @return true if the value was removed, false if it does not exist
      */
-    void remove_(BinTree& tree, const T& value);
+    template <typename K>
+    bool remove_(BinTree& tree, const K& value);
 
     /**
-     * @brief A recursive step to calculate the height of the tree
+     * @brief An iterative step to calculate the height of the tree
+     *        using an explicit stack instead of the call stack
      * @param tree The tree to be calculated
      * @return The height of the tree
      */
     int height_(const BinTree& tree) const;
 
     /**
-     * @brief A recursive step to copy the tree 
-     * @param tree The tree to be copied
-     * @param rtree The tree to be copied to
+     * @brief A step to copy the tree
+     *        All the nodes are allocated up front in one batch, which
+     *        copyNodes_() hands out in pre-order
+     * @param tree The tree to be copied to
+     * @param rtree The tree to be copied
+     * @param threads The number of threads to copy with
      */
-    void copy_(BinTree& tree, const BinTree& rtree);
+    void copy_(BinTree& tree, const BinTree& rtree, unsigned threads);
+
+    /**
+     * @brief A step to copy the nodes of a tree into blocks in pre-order
+     *        A subtree takes the blocks after its root's, the left subtree
+     *        first, so the two subtrees of a big enough node can be copied
+     *        by different threads (iteratively each)
+     *        The block of each node made is set to null, so that only the
+     *        unused blocks are left to be freed if copying a value throws
+     * @param rtree The tree to be copied
+     * @param link The link to put the copy in
+     * @param blocks The blocks for the nodes, as many as rtree has
+     * @param threads The number of threads to copy with
+     */
+    static void copyNodes_(BinTree rtree, BinTree* link, void** blocks,
+                           unsigned threads);
+
+    /**
+     * @brief A recursive step to build a balanced tree from a sorted range
+     *        The values and blocks are consumed in order (in-order traversal)
+     *        and each used block is set to null
+     *        The nodes made are always linked under tree, even if copying
+     *        a value throws
+     * @param it The next value to be used (advanced as values are used)
+     * @param n The number of nodes in the tree to be built
+     * @param blocks The next allocated block to be used (advanced as well)
+     * @param tree The (empty) link the tree built goes into
+     */
+    template <typename ForwardIt>
+    void build_(ForwardIt& it, unsigned n, void**& blocks, BinTree& tree);
+
+    /**
+     * @brief Merge the values of another tree into this one in order, and
+     *        relink the nodes that are kept (see unionWith())
+     * @param other The tree to be merged with
+     * @param isKeepingOurs true to keep the values that are only ours
+     * @param isKeepingBoth true to keep the values in both trees
+     * @param isAddingTheirs true to add the values that are only theirs
+     * @param threads The number of threads that walk and relink the trees
+     */
+    void merge_(const BST& other, bool isKeepingOurs, bool isKeepingBoth,
+                bool isAddingTheirs, unsigned threads);
+
+    /**
+     * @brief A step to list the nodes of a tree in order
+     *        The root goes at the index of its left count, so the subtrees
+     *        can be listed by different threads (iteratively each)
+     * @param tree The tree to be listed
+     * @param nodes Where the nodes go (tree->count of them)
+     * @param threads The number of threads to list them with
+     */
+    static void flatten_(BinTree tree, BinTree* nodes, unsigned threads);
+
+    /**
+     * @brief A recursive step to link nodes listed in order into a
+     *        height-optimal tree, the same shape that build_() makes
+     *        The two subtrees are linked by different threads while there
+     *        is more than one thread and enough nodes
+     * @param nodes The nodes in order
+     * @param n The number of nodes
+     * @param threads The number of threads to link them with
+     * @return The root of the tree
+     */
+    static BinTree relink_(BinTree* nodes, unsigned n, unsigned threads);
+
+    /**
+     * @brief Run two tasks, on two threads if there is more than one
+     *        (falling back to one thread if no thread can be started)
+     * @param threads The number of threads to run them with
+     * @param first The task to be run on a new thread
+     * @param second The task to be run on this thread
+     */
+    template <typename First, typename Second>
+    static void forkJoin_(unsigned threads, First first, Second second);
+
+    /**
+     * @brief An iterative step to free all nodes in the tree
+     *        Left children are rotated up so that no stack is needed
+     *        The nodes are given back in batches, or, if the tree is the
+     *        only owner of its allocator, by releasing all its pages at
+     *        once (and if T needs no destructor the nodes are not even
+     *        walked)
+     * @param tree The tree to be freed (set to nullptr after)
+     */
+    void clear_(BinTree& tree);
 };
 
+/**
+ * @brief Swap two trees in O(1) (see BST::swap())
+ * @param lhs The 1st BST
+ * @param rhs The 2nd BST
+ */
+template <typename T, typename Compare>
+void swap(BST<T, Compare>& lhs, BST<T, Compare>& rhs) noexcept;
+
 // This is the header file but it is including the implemention cpp because
 // is a templated class. In C++, the compiler needs to know the implementation
 // of the class in order to compile it. The compiler does not know what type
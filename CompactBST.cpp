@@ -0,0 +1,233 @@
+/**
+ * @file CompactBST.cpp
+ * @author Chek
+ * @brief CompactBST class implementation
+ *        This file is included by CompactBST.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "CompactBST.h"
+#include <new>
+#include <utility>
+
+template <typename T, typename Compare, typename Index>
+CompactBST<T, Compare, Index>::CompactBST(const Compare& compare)
+    : pages_(), root_(NIL), freeList_(NIL), used_(0), compare_(compare),
+      path_() {}
+
+template <typename T, typename Compare, typename Index>
+typename CompactBST<T, Compare, Index>::Node&
+CompactBST<T, Compare, Index>::node(Index index) {
+    return pages_[index / NODES_PER_PAGE][index % NODES_PER_PAGE];
+}
+
+template <typename T, typename Compare, typename Index>
+const typename CompactBST<T, Compare, Index>::Node&
+CompactBST<T, Compare, Index>::node(Index index) const {
+    return pages_[index / NODES_PER_PAGE][index % NODES_PER_PAGE];
+}
+
+template <typename T, typename Compare, typename Index>
+void CompactBST<T, Compare, Index>::add(const T& value) {
+    path_.clear();
+
+    // walk down to the empty link the value goes into
+    Index* link = &root_;
+    while (*link != NIL) {
+        Node& current = node(*link);
+        if (compare_(value, current.data)) {
+            path_.push_back(link);
+            link = &current.left;
+        } else if (compare_(current.data, value)) {
+            path_.push_back(link);
+            link = &current.right;
+        } else
+            throw BSTException(BSTException::E_DUPLICATE,
+                               "Value to add already exists in the tree");
+    }
+
+    // the links stay valid as adding a page never moves the other pages
+    Index index = allocateNode();
+    Node& added = node(index);
+    try {
+        added.data = value;
+    } catch (...) {
+        added.left = freeList_;
+        freeList_ = index;
+        throw;
+    }
+    added.left = NIL;
+    added.right = NIL;
+    added.count = 1;
+    *link = index;
+
+    updatePath(1);
+}
+
+template <typename T, typename Compare, typename Index>
+void CompactBST<T, Compare, Index>::remove(const T& value) {
+    path_.clear();
+
+    // walk down to the node holding the value
+    Index* link = &root_;
+    while (*link != NIL) {
+        Node& current = node(*link);
+        if (compare_(value, current.data)) {
+            path_.push_back(link);
+            link = &current.left;
+        } else if (compare_(current.data, value)) {
+            path_.push_back(link);
+            link = &current.right;
+        } else
+            break;
+    }
+
+    if (*link == NIL)
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+
+    // two children: replace with the predecessor
+    // and remove the predecessor's node from the left subtree instead
+    Index index = *link;
+    if (node(index).left != NIL && node(index).right != NIL) {
+        path_.push_back(link);
+        link = &node(index).left;
+        while (node(*link).right != NIL) {
+            path_.push_back(link);
+            link = &node(*link).right;
+        }
+        node(index).data = std::move(node(*link).data);
+        index = *link;
+    }
+
+    // the node has at most one child now, which takes its place
+    Node& removed = node(index);
+    *link = removed.left != NIL ? removed.left : removed.right;
+    removed.left = freeList_;
+    freeList_ = index;
+
+    updatePath(-1);
+}
+
+template <typename T, typename Compare, typename Index>
+void CompactBST<T, Compare, Index>::clear() {
+    pages_.clear();
+    root_ = NIL;
+    freeList_ = NIL;
+    used_ = 0;
+}
+
+template <typename T, typename Compare, typename Index>
+bool CompactBST<T, Compare, Index>::find(const T& value,
+                                         unsigned& compares) const {
+    compares = 0;
+    Index index = root_;
+    while (index != NIL) {
+        const Node& current = node(index);
+        ++compares;
+        if (compare_(value, current.data))
+            index = current.left;
+        else if (compare_(current.data, value))
+            index = current.right;
+        else
+            return true;
+    }
+
+    // reached the end without finding the value
+    return false;
+}
+
+template <typename T, typename Compare, typename Index>
+const T* CompactBST<T, Compare, Index>::operator[](int index) const {
+    // check the index before doing the traversal
+    if (index < 0 || static_cast<unsigned>(index) >= size())
+        throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+
+    Index current = root_;
+    while (current != NIL) {
+        const Node& n = node(current);
+        // L is the number of nodes in the left subtree
+        int L = n.left == NIL ? 0 : static_cast<int>(node(n.left).count);
+        if (L > index)
+            current = n.left;
+        else if (L < index) {
+            index -= L + 1;
+            current = n.right;
+        } else
+            return &n.data;
+    }
+
+    throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+}
+
+template <typename T, typename Compare, typename Index>
+bool CompactBST<T, Compare, Index>::empty() const {
+    return root_ == NIL;
+}
+
+template <typename T, typename Compare, typename Index>
+unsigned CompactBST<T, Compare, Index>::size() const {
+    return root_ == NIL ? 0 : static_cast<unsigned>(node(root_).count);
+}
+
+template <typename T, typename Compare, typename Index>
+int CompactBST<T, Compare, Index>::height() const {
+    // an empty tree has a height of -1 so that a leaf has a height of 0
+    int height = -1;
+    if (root_ == NIL)
+        return height;
+
+    // depth-first walk down the left children, leaving the right children
+    // and their depths on the stack to be walked later
+    std::vector<std::pair<Index, int>> stack;
+    stack.push_back(std::make_pair(root_, 0));
+    while (!stack.empty()) {
+        Index index = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        for (; index != NIL; index = node(index).left, ++depth) {
+            if (depth > height)
+                height = depth;
+            if (node(index).right != NIL)
+                stack.push_back(std::make_pair(node(index).right, depth + 1));
+        }
+    }
+
+    return height;
+}
+
+template <typename T, typename Compare, typename Index>
+size_t CompactBST<T, Compare, Index>::pageBytes() const {
+    return pages_.size() * NODES_PER_PAGE * sizeof(Node);
+}
+
+template <typename T, typename Compare, typename Index>
+Index CompactBST<T, Compare, Index>::allocateNode() {
+    // reuse a removed node first
+    if (freeList_ != NIL) {
+        Index index = freeList_;
+        freeList_ = node(index).left;
+        return index;
+    }
+
+    // NIL is not a valid index, so it caps the number of nodes
+    if (used_ == NIL)
+        throw BSTException(BSTException::E_NO_MEMORY,
+                           "No node index left for the value to add");
+
+    if (used_ % NODES_PER_PAGE == 0) {
+        try {
+            pages_.emplace_back(NODES_PER_PAGE);
+        } catch (const std::bad_alloc&) {
+            throw BSTException(BSTException::E_NO_MEMORY,
+                               "No memory left for a page of nodes");
+        }
+    }
+    return used_++;
+}
+
+template <typename T, typename Compare, typename Index>
+void CompactBST<T, Compare, Index>::updatePath(int delta) {
+    for (Index* link : path_)
+        node(*link).count += static_cast<Index>(delta);
+}
@@ -0,0 +1,178 @@
+/**
+ * @file CompactBST.h
+ * @author Chek
+ * @brief CompactBST class definition
+ *        A BST whose nodes link to each other with 32-bit indices
+ * @date 12 Sep 2023
+ */
+#ifndef COMPACTBST_H
+#define COMPACTBST_H
+#include "BST.h" // for BSTException and BST_OBJECTS_PER_PAGE
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+/**
+ * @class CompactBST
+ * @brief A Binary Search Tree with the same behaviour as BST, but whose
+ *       nodes are kept in pages owned by the tree and link to their
+ *       children by index instead of by pointer
+ *       - with 32-bit indices, a node of a CompactBST<int> is 16 bytes
+ *         instead of the 32 bytes of a BST<int>::BinTreeNode, so it takes
+ *         half the memory and 4 nodes fit in a cache line instead of 2
+ *       - the pages never move, so an index stays valid until its node
+ *         is removed, and a copy of the tree copies the pages as they are
+ *       - removed nodes are reused (their left index links the free ones)
+ *       - it is not a balanced tree and has no iterators
+ * @tparam T The type of the values (default constructible and movable)
+ * @tparam Compare The comparison function object (see BST)
+ * @tparam Index The unsigned type of the node indices, which also limits
+ *               the number of nodes (uint16_t for small trees, uint64_t
+ *               for more than 4G nodes)
+ */
+template <typename T, typename Compare = std::less<T>, typename Index = uint32_t>
+class CompactBST {
+  public:
+    static_assert(std::numeric_limits<Index>::is_integer && !std::numeric_limits<Index>::is_signed,
+                  "Index must be an unsigned integer type");
+
+    // the index that links to no node
+    static constexpr Index NIL = std::numeric_limits<Index>::max();
+
+    /**
+     * @struct Node
+     * @brief A node in the tree
+     */
+    struct Node {
+        // left and right child indices (NIL if none)
+        Index left;
+        Index right;
+
+        // the data stored in the node
+        T data;
+
+        // the number of nodes in the subtree rooted at this node
+        Index count;
+    };
+
+    /**
+     * @brief Default constructor
+     * @param compare The comparison function object to order the values
+     */
+    explicit CompactBST(const Compare& compare = Compare());
+
+    /**
+     * @brief Add a value to the tree
+     * @param value The value to be added
+     * @throws BSTException E_DUPLICATE if the value is already in the tree,
+     *         E_NO_MEMORY if every index is in use or the memory runs out
+     */
+    void add(const T& value);
+
+    /**
+     * @brief Remove a value from the tree
+     * @param value The value to be removed
+     * @throws BSTException E_NOT_FOUND if the value is not in the tree
+     */
+    void remove(const T& value);
+
+    /**
+     * @brief Remove all the values (and release the pages)
+     */
+    void clear();
+
+    /**
+     * @brief Find a value in the tree
+     * @param value The value to be found
+     * @param compares The number of comparisons made (an output)
+     * @return true if the value is found
+     */
+    bool find(const T& value, unsigned& compares) const;
+
+    /**
+     * @brief Get the value at an index in the sorted order
+     * @param index The index of the value (0 for the smallest)
+     * @return The value (never nullptr), where BST returns the node, so
+     *         only the out-of-range behaviour matches BST's
+     * @throws BSTException E_OUT_BOUNDS if the index is out of range
+     */
+    const T* operator[](int index) const;
+
+    /**
+     * @brief Check if the tree is empty
+     * @return true if there are no values in the tree
+     */
+    bool empty() const;
+
+    /**
+     * @brief Get the number of values in the tree
+     * @return The number of values
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Get the height of the tree
+     * @return The height (-1 for an empty tree, 0 for a single node)
+     */
+    int height() const;
+
+    /**
+     * @brief Get the memory held by the pages of nodes
+     * @return The size of the pages in bytes
+     */
+    size_t pageBytes() const;
+
+  private:
+    // nodes per page (a power of 2, so an index splits with a shift and a mask)
+    static constexpr Index NODES_PER_PAGE = BST_OBJECTS_PER_PAGE;
+    static_assert(BST_OBJECTS_PER_PAGE <= std::numeric_limits<Index>::max(),
+                  "Index must be able to index a page");
+    static_assert((NODES_PER_PAGE & (NODES_PER_PAGE - 1)) == 0,
+                  "NODES_PER_PAGE must be a power of 2");
+
+    // the pages of nodes (each one has NODES_PER_PAGE nodes and never moves)
+    std::vector<std::vector<Node>> pages_;
+
+    // the root of the tree (NIL if empty)
+    Index root_;
+
+    // the 1st free node (NIL if none), linked through the left indices
+    Index freeList_;
+
+    // the number of nodes handed out from the pages so far
+    Index used_;
+
+    // the comparison function object
+    Compare compare_;
+
+    // the links walked by the last add or remove, from the root down
+    std::vector<Index*> path_;
+
+    /**
+     * @brief Get a node from its index
+     * @param index The index of the node (not NIL)
+     * @return The node
+     */
+    Node& node(Index index);
+    const Node& node(Index index) const;
+
+    /**
+     * @brief Get a free node, adding a page if none is left
+     * @return The index of the node
+     * @throws BSTException E_NO_MEMORY if every index is in use
+     *         or the page cannot be allocated
+     */
+    Index allocateNode();
+
+    /**
+     * @brief Add the change in size to the counts of the nodes on path_
+     * @param delta +1 after an add, -1 after a remove
+     */
+    void updatePath(int delta);
+};
+
+// include the implementation as CompactBST is a templated class (see BST.h)
+#include "CompactBST.cpp"
+
+#endif
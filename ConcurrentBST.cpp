@@ -0,0 +1,370 @@
+/**
+ * @file ConcurrentBST.cpp
+ * @author Chek
+ * @brief ConcurrentBST class implementation
+ *        This file is included by ConcurrentBST.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "ConcurrentBST.h"
+#include <functional>
+#include <new>
+#include <thread>
+
+template <typename T, typename Compare>
+ConcurrentBST<T, Compare>::ReadGuard::ReadGuard(const ConcurrentBST& tree)
+    : slot_(nullptr) {
+    // start each thread on its own slot so that the claim rarely contends
+    static thread_local const unsigned start = static_cast<unsigned>(
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+    // claim a free slot with the current epoch, so that the writer keeps
+    // every node this reader may reach until the slot is freed again
+    // (the root is loaded after the claim, see publish())
+    for (unsigned i = 0; i < CONCURRENT_BST_READER_SLOTS; ++i) {
+        ReaderSlot& slot = tree.readers_[(start + i) % CONCURRENT_BST_READER_SLOTS];
+        if (claim(slot, tree.epoch_.load())) {
+            slot_ = &slot;
+            return;
+        }
+    }
+    for (ReaderSlot* slot = tree.addedReaders_.load(); slot != nullptr; slot = slot->next) {
+        if (claim(*slot, tree.epoch_.load())) {
+            slot_ = slot;
+            return;
+        }
+    }
+
+    // every slot is taken, so add one already claimed rather than wait
+    // - pushing it is the claim, which the writer's scan sees or else the
+    //   root is loaded after it
+    slot_ = new ReaderSlot;
+    slot_->epoch.store(tree.epoch_.load(), std::memory_order_relaxed);
+    slot_->next = tree.addedReaders_.load();
+    while (!tree.addedReaders_.compare_exchange_weak(slot_->next, slot_)) {
+    }
+}
+
+template <typename T, typename Compare>
+bool ConcurrentBST<T, Compare>::ReadGuard::claim(ReaderSlot& slot, uint64_t epoch) {
+    uint64_t expected = 0;
+    return slot.epoch.load(std::memory_order_relaxed) == 0 &&
+           slot.epoch.compare_exchange_strong(expected, epoch);
+}
+
+template <typename T, typename Compare>
+ConcurrentBST<T, Compare>::ReadGuard::~ReadGuard() {
+    slot_->epoch.store(0, std::memory_order_release);
+}
+
+template <typename T, typename Compare>
+ConcurrentBST<T, Compare>::ConcurrentBST(SimpleAllocator* allocator,
+                                         const Compare& compare)
+    : root_(nullptr), allocator_(allocator), isOwnAllocator_(false),
+      compare_(compare), writeMutex_(), epoch_(1), addedReaders_(nullptr), retired_() {
+    for (ReaderSlot& slot : readers_) {
+        slot.epoch.store(0, std::memory_order_relaxed);
+        slot.next = nullptr;
+    }
+
+    if (allocator_ == nullptr) {
+        SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+        allocator_ = new SimpleAllocator(sizeof(Node), config);
+        isOwnAllocator_ = true;
+    }
+}
+
+template <typename T, typename Compare>
+ConcurrentBST<T, Compare>::~ConcurrentBST() {
+    // no one is reading, so every retired node can go
+    for (const std::pair<uint64_t, const Node*>& retired : retired_)
+        freeNode(retired.second);
+
+    // free the newest version with a depth-first walk
+    std::vector<const Node*> stack;
+    if (root_.load() != nullptr)
+        stack.push_back(root_.load());
+    while (!stack.empty()) {
+        const Node* node = stack.back();
+        stack.pop_back();
+        if (node->left != nullptr)
+            stack.push_back(node->left);
+        if (node->right != nullptr)
+            stack.push_back(node->right);
+        freeNode(node);
+    }
+
+    if (isOwnAllocator_)
+        delete allocator_;
+
+    while (ReaderSlot* slot = addedReaders_.load()) {
+        addedReaders_.store(slot->next);
+        delete slot;
+    }
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::add(const T& value) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    // walk down to the empty link the value goes into
+    // (only the writer changes the root, so this version stays put)
+    std::vector<const Node*> path;
+    const Node* current = root_.load(std::memory_order_relaxed);
+    while (current != nullptr) {
+        path.push_back(current);
+        if (compare_(value, current->data))
+            current = current->left;
+        else if (compare_(current->data, value))
+            current = current->right;
+        else
+            throw BSTException(BSTException::E_DUPLICATE,
+                               "Value to add already exists in the tree");
+    }
+
+    // copy the path bottom up, each copy one bigger and linked to the
+    // copy below it
+    std::vector<const Node*> made;
+    const Node* below = makeNode(nullptr, nullptr, value, 1, made);
+    for (size_t i = path.size(); i-- > 0;) {
+        const Node* node = path[i];
+        bool isLeft = compare_(value, node->data);
+        below = makeNode(isLeft ? below : node->left,
+                         isLeft ? node->right : below, node->data,
+                         node->count + 1, made);
+    }
+
+    publish(below, path);
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::remove(const T& value) {
+    std::lock_guard<std::mutex> lock(writeMutex_);
+
+    // walk down to the node holding the value
+    std::vector<const Node*> path;
+    const Node* current = root_.load(std::memory_order_relaxed);
+    while (current != nullptr) {
+        path.push_back(current);
+        if (compare_(value, current->data))
+            current = current->left;
+        else if (compare_(current->data, value))
+            current = current->right;
+        else
+            break;
+    }
+
+    if (current == nullptr)
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+
+    std::vector<const Node*> made;
+    std::vector<const Node*> replaced(path);
+    const Node* below = nullptr;
+    if (current->left == nullptr || current->right == nullptr)
+        // at most one child, which takes its place
+        below = current->left != nullptr ? current->left : current->right;
+    else {
+        // two children: the predecessor takes its place, so copy the
+        // right spine of the left subtree without the predecessor
+        std::vector<const Node*> spine;
+        const Node* pred = current->left;
+        while (pred->right != nullptr) {
+            spine.push_back(pred);
+            pred = pred->right;
+        }
+        replaced.insert(replaced.end(), spine.begin(), spine.end());
+        replaced.push_back(pred);
+
+        const Node* left = pred->left;
+        for (size_t i = spine.size(); i-- > 0;)
+            left = makeNode(spine[i]->left, left, spine[i]->data,
+                            spine[i]->count - 1, made);
+        below = makeNode(left, current->right, pred->data, current->count - 1,
+                         made);
+    }
+
+    // copy the path above bottom up, each copy one smaller
+    path.pop_back();
+    for (size_t i = path.size(); i-- > 0;) {
+        const Node* node = path[i];
+        bool isLeft = compare_(value, node->data);
+        below = makeNode(isLeft ? below : node->left,
+                         isLeft ? node->right : below, node->data,
+                         node->count - 1, made);
+    }
+
+    publish(below, replaced);
+}
+
+template <typename T, typename Compare>
+bool ConcurrentBST<T, Compare>::find(const T& value, unsigned& compares) const {
+    ReadGuard guard(*this);
+
+    compares = 0;
+    const Node* current = root_.load();
+    while (current != nullptr) {
+        ++compares;
+        if (compare_(value, current->data))
+            current = current->left;
+        else if (compare_(current->data, value))
+            current = current->right;
+        else
+            return true;
+    }
+
+    // reached the end without finding the value
+    return false;
+}
+
+template <typename T, typename Compare>
+T ConcurrentBST<T, Compare>::operator[](int index) const {
+    ReadGuard guard(*this);
+
+    const Node* current = root_.load();
+    if (index >= 0) {
+        while (current != nullptr) {
+            // L is the number of nodes in the left subtree
+            int L = static_cast<int>(size_(current->left));
+            if (L > index)
+                current = current->left;
+            else if (L < index) {
+                index -= L + 1;
+                current = current->right;
+            } else
+                return current->data;
+        }
+    }
+
+    throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+}
+
+template <typename T, typename Compare>
+unsigned ConcurrentBST<T, Compare>::size() const {
+    ReadGuard guard(*this);
+    return size_(root_.load());
+}
+
+template <typename T, typename Compare>
+int ConcurrentBST<T, Compare>::height() const {
+    ReadGuard guard(*this);
+
+    // an empty tree has a height of -1 so that a leaf has a height of 0
+    int height = -1;
+    std::vector<std::pair<const Node*, int>> stack;
+    if (root_.load() != nullptr)
+        stack.push_back(std::make_pair(root_.load(), 0));
+    while (!stack.empty()) {
+        const Node* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        for (; node != nullptr; node = node->left, ++depth) {
+            if (depth > height)
+                height = depth;
+            if (node->right != nullptr)
+                stack.push_back(std::make_pair(node->right, depth + 1));
+        }
+    }
+
+    return height;
+}
+
+template <typename T, typename Compare>
+const typename ConcurrentBST<T, Compare>::Node*
+ConcurrentBST<T, Compare>::makeNode(const Node* left, const Node* right,
+                                    const T& data, unsigned count,
+                                    std::vector<const Node*>& made) {
+    // the update fails as a whole, freeing the nodes it made so far
+    // (no reader has seen them as they are not published yet)
+    void* mem = nullptr;
+    try {
+        mem = allocator_->allocate();
+    } catch (const SimpleAllocatorException& e) {
+        freeNodes(made);
+        throw BSTException(BSTException::E_NO_MEMORY, e.what());
+    }
+
+    // construct the node in place, giving the memory back if T throws
+    const Node* node = nullptr;
+    try {
+        node = new (mem) Node{left, right, data, count};
+    } catch (...) {
+        allocator_->free(mem);
+        freeNodes(made);
+        throw;
+    }
+
+    try {
+        made.push_back(node);
+    } catch (...) {
+        freeNode(node);
+        freeNodes(made);
+        throw;
+    }
+    return node;
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::freeNodes(const std::vector<const Node*>& nodes) {
+    for (const Node* node : nodes)
+        freeNode(node);
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::freeNode(const Node* node) {
+    // destroy the node explicitly as it was constructed with placement new
+    node->~Node();
+    allocator_->free(const_cast<Node*>(node));
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::publish(const Node* root,
+                                        const std::vector<const Node*>& replaced) {
+    // the store and the loads of the scan in reclaim() are all seq_cst, so
+    // it is ordered before the scan, and a reader whose slot the scan
+    // missed claimed it later and loads this root or a newer one
+    root_.store(root);
+
+    // readers that started in this epoch or before may still be on the
+    // replaced nodes, while readers that start from now on cannot reach them
+    uint64_t epoch = epoch_.fetch_add(1);
+    for (const Node* node : replaced)
+        retired_.push_back(std::make_pair(epoch, node));
+
+    if (retired_.size() >= CONCURRENT_BST_RECLAIM_BATCH)
+        reclaim();
+}
+
+template <typename T, typename Compare>
+void ConcurrentBST<T, Compare>::reclaim() {
+    // the oldest epoch a reader is still in
+    // - the loads are seq_cst like the root store in publish() and the
+    //   claim and root load in ReadGuard, so either the scan sees a claim
+    //   or the reader that made it loads the newest root
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& slot : readers_) {
+        uint64_t epoch = slot.epoch.load();
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+    for (const ReaderSlot* slot = addedReaders_.load(); slot != nullptr; slot = slot->next) {
+        uint64_t epoch = slot->epoch.load();
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    // free what was retired before it, keeping the rest in order
+    size_t kept = 0;
+    for (size_t i = 0; i < retired_.size(); ++i) {
+        if (retired_[i].first < oldest)
+            freeNode(retired_[i].second);
+        else
+            retired_[kept++] = retired_[i];
+    }
+    retired_.resize(kept);
+}
+
+template <typename T, typename Compare>
+unsigned ConcurrentBST<T, Compare>::size_(const Node* node) {
+    return node == nullptr ? 0 : node->count;
+}
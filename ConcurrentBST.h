@@ -0,0 +1,240 @@
+/**
+ * @file ConcurrentBST.h
+ * @author Chek
+ * @brief ConcurrentBST class definition
+ *        A BST that many threads can read while one thread updates it
+ * @date 12 Sep 2023
+ */
+#ifndef CONCURRENTBST_H
+#define CONCURRENTBST_H
+#include "BST.h" // for BSTException and the allocator defaults
+#include "SimpleAllocator.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// The number of reader slots a ConcurrentBST has to start with
+// (a reader that finds them all taken adds a slot of its own)
+static const unsigned CONCURRENT_BST_READER_SLOTS = 64;
+
+// The number of replaced nodes a ConcurrentBST collects before it frees
+// the ones that no reader can still be using
+static const unsigned CONCURRENT_BST_RECLAIM_BATCH = 256;
+
+/**
+ * @class ConcurrentBST
+ * @brief A Binary Search Tree with the same ordering and duplicates rule
+ *       as BST, where find(), operator[], size() and height() can be
+ *       called from any number of threads while add() and remove() are
+ *       called from another
+ *       - readers never block: a node is never changed once the tree
+ *         links to it, so add() and remove() copy the path from the root
+ *         down to the change (with its counts updated) and then swing the
+ *         root over to the copy in one atomic store
+ *       - each reader walks the tree version it started on, and the nodes
+ *         that later versions replaced are only freed once no reader that
+ *         could have seen them is still reading (epoch-based reclamation)
+ *       - writers are serialized by a mutex, so updates cost O(height)
+ *         node allocations and are best kept to one thread
+ *       - it is not a balanced tree
+ * @tparam T The type of the values (copy constructible)
+ * @tparam Compare The comparison function object (see BST)
+ */
+template <typename T, typename Compare = std::less<T>>
+class ConcurrentBST {
+  public:
+    /**
+     * @struct Node
+     * @brief A node in the tree (never changed once linked into the tree)
+     */
+    struct Node {
+        // left and right child pointers
+        const Node* left;
+        const Node* right;
+
+        // the data stored in the node
+        T data;
+
+        // the number of nodes in the subtree rooted at this node
+        unsigned count;
+    };
+
+    /**
+     * @brief Default constructor
+     * @param allocator The allocator for the nodes, which only the writer
+     *                  uses (one is created if none is given)
+     * @param compare The comparison function object to order the values
+     */
+    ConcurrentBST(SimpleAllocator* allocator = nullptr,
+                  const Compare& compare = Compare());
+
+    /**
+     * @brief Destructor
+     *        No thread may be reading or writing the tree
+     */
+    ~ConcurrentBST();
+
+    /**
+     * @brief Add a value to the tree (for the writer)
+     * @param value The value to be added
+     * @throws BSTException E_DUPLICATE if the value is already in the tree,
+     *         E_NO_MEMORY if the allocator runs out (the tree is unchanged)
+     */
+    void add(const T& value);
+
+    /**
+     * @brief Remove a value from the tree (for the writer)
+     * @param value The value to be removed
+     * @throws BSTException E_NOT_FOUND if the value is not in the tree,
+     *         E_NO_MEMORY if the allocator runs out (the tree is unchanged)
+     */
+    void remove(const T& value);
+
+    /**
+     * @brief Find a value in the tree (for any thread, never blocks)
+     * @param value The value to be found
+     * @param compares The number of comparisons made (an output)
+     * @return true if the value is found
+     */
+    bool find(const T& value, unsigned& compares) const;
+
+    /**
+     * @brief Get a copy of the value at an index in the sorted order
+     *        (for any thread, never blocks)
+     *        It is returned by value as the node may be freed once the
+     *        reader is done with it
+     * @param index The index of the value (0 for the smallest)
+     * @return The value
+     * @throws BSTException E_OUT_BOUNDS if the index is out of range
+     */
+    T operator[](int index) const;
+
+    /**
+     * @brief Get the number of values in the tree (for any thread)
+     * @return The number of values
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Get the height of the tree (for any thread, O(n))
+     * @return The height (-1 for an empty tree, 0 for a single node)
+     */
+    int height() const;
+
+  private:
+    // Disable copy constructor and assignment operator
+    ConcurrentBST(const ConcurrentBST&) = delete;
+    ConcurrentBST& operator=(const ConcurrentBST&) = delete;
+
+    /**
+     * @struct ReaderSlot
+     * @brief The epoch a reader started in (0 if the slot is free),
+     *        on a cache line of its own so that readers do not share lines
+     */
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch;
+
+        // the next added slot (only set before the slot is added)
+        ReaderSlot* next;
+    };
+
+    /**
+     * @class ReadGuard
+     * @brief Holds a reader slot for as long as it lives
+     */
+    class ReadGuard {
+      public:
+        explicit ReadGuard(const ConcurrentBST& tree);
+        ~ReadGuard();
+
+      private:
+        ReaderSlot* slot_;
+
+        /**
+         * @brief Claim a slot if it is free
+         * @param slot The slot to be claimed
+         * @param epoch The epoch the reader starts in
+         * @return true if the slot was free and is now the reader's
+         */
+        static bool claim(ReaderSlot& slot, uint64_t epoch);
+    };
+
+    // the root of the newest version of the tree
+    std::atomic<const Node*> root_;
+
+    // the allocator for the nodes and whether the tree owns it
+    SimpleAllocator* allocator_;
+    bool isOwnAllocator_;
+
+    // orders the values, i.e., compare_(a, b) is true if a goes before b
+    Compare compare_;
+
+    // serializes the writers
+    std::mutex writeMutex_;
+
+    // the epoch that new readers start in (starts at 1 as 0 marks a free slot)
+    std::atomic<uint64_t> epoch_;
+
+    // the slots of the threads that are reading
+    mutable ReaderSlot readers_[CONCURRENT_BST_READER_SLOTS];
+
+    // the slots added by readers that found every other slot taken
+    // - slots are pushed at the front and only freed with the tree
+    mutable std::atomic<ReaderSlot*> addedReaders_;
+
+    // nodes replaced by a later version, with the epoch they were replaced in
+    std::vector<std::pair<uint64_t, const Node*>> retired_;
+
+    /**
+     * @brief Make a node
+     * @param left The left child
+     * @param right The right child
+     * @param data The value
+     * @param count The number of nodes in its subtree
+     * @param made The nodes made so far by the update, to be freed if it fails
+     * @return The node
+     * @throws BSTException E_NO_MEMORY if the allocator runs out
+     */
+    const Node* makeNode(const Node* left, const Node* right, const T& data,
+                         unsigned count, std::vector<const Node*>& made);
+
+    /**
+     * @brief Free a node straight away (it must not be reachable by a reader)
+     * @param node The node to be freed
+     */
+    void freeNode(const Node* node);
+
+    /**
+     * @brief Free nodes straight away (none may be reachable by a reader)
+     * @param nodes The nodes to be freed
+     */
+    void freeNodes(const std::vector<const Node*>& nodes);
+
+    /**
+     * @brief Make a new version with a copied path the newest one, and retire
+     *        the nodes it replaced
+     * @param root The root of the new version
+     * @param replaced The nodes of the old version that are not in the new one
+     */
+    void publish(const Node* root, const std::vector<const Node*>& replaced);
+
+    /**
+     * @brief Free the retired nodes that no reader can still be using
+     */
+    void reclaim();
+
+    /**
+     * @brief Get the number of nodes in a subtree
+     * @param node The root of the subtree
+     * @return The number of nodes (0 for an empty subtree)
+     */
+    static unsigned size_(const Node* node);
+};
+
+// include the implementation as ConcurrentBST is a templated class (see BST.h)
+#include "ConcurrentBST.cpp"
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file FrozenBST.cpp
+ * @author Chek
+ * @brief FrozenBST class implementation
+ *        This file is included by FrozenBST.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "FrozenBST.h"
+
+template <typename T, typename Compare>
+FrozenBST<T, Compare>::FrozenBST(const BST<T, Compare>& tree)
+    : data_(), compare_(tree.comparator()) {
+    size_t n = tree.size();
+    if (n == 0)
+        return;
+
+    // the values in order, without copying them yet
+    std::vector<const T*> sorted;
+    sorted.reserve(n);
+    for (const T& value : tree)
+        sorted.push_back(&value);
+
+    // the slots of the complete tree in order are its in-order walk,
+    // starting from the leftmost slot
+    std::vector<size_t> slotRanks(n + 1);
+    size_t k = 1;
+    while (2 * k <= n)
+        k *= 2;
+    for (size_t rank = 0; rank < n; ++rank) {
+        slotRanks[k] = rank;
+
+        if (2 * k + 1 <= n) {
+            // the next slot is the leftmost one in the right subtree
+            k = 2 * k + 1;
+            while (2 * k <= n)
+                k *= 2;
+        } else {
+            // otherwise go up past the right children, then up once more
+            while (k & 1)
+                k >>= 1;
+            k >>= 1;
+        }
+    }
+
+    data_.reserve(n);
+    for (k = 1; k <= n; ++k)
+        data_.push_back(*sorted[slotRanks[k]]);
+}
+
+template <typename T, typename Compare>
+bool FrozenBST<T, Compare>::find(const T& value, unsigned& compares) const {
+    return find_(value, compares);
+}
+
+template <typename T, typename Compare>
+template <typename K, typename C, typename>
+bool FrozenBST<T, Compare>::find(const K& key, unsigned& compares) const {
+    return find_(key, compares);
+}
+
+template <typename T, typename Compare>
+const T* FrozenBST<T, Compare>::lowerBound(const T& value) const {
+    unsigned levels = 0;
+    size_t k = lowerBoundSlot_(value, levels);
+    return k == 0 ? nullptr : &data_[k - 1];
+}
+
+template <typename T, typename Compare>
+bool FrozenBST<T, Compare>::empty() const {
+    return data_.empty();
+}
+
+template <typename T, typename Compare>
+unsigned FrozenBST<T, Compare>::size() const {
+    return static_cast<unsigned>(data_.size());
+}
+
+template <typename T, typename Compare>
+const std::vector<T>& FrozenBST<T, Compare>::data() const {
+    return data_;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+size_t FrozenBST<T, Compare>::lowerBoundSlot_(const K& value,
+                                              unsigned& levels) const {
+    const T* values = data_.data();
+    size_t n = data_.size();
+
+    // go down to past a leaf, turning right (appending a 1 bit to the slot)
+    // whenever the value at the slot is less than the value
+    size_t k = 1;
+    while (k <= n) {
+#if defined(__GNUC__)
+        // fetch the cache line of descendants a few levels down, if there
+        // are any (forming a pointer past the values is undefined)
+        if (k * PREFETCH_STRIDE <= n)
+            __builtin_prefetch(values + k * PREFETCH_STRIDE - 1);
+#endif
+        k = 2 * k + compare_(values[k - 1], value);
+        ++levels;
+    }
+
+    // the lower bound is where we last turned left, so drop the right
+    // turns after it and the left turn itself (0 if we never turned left)
+    while (k & 1)
+        k >>= 1;
+    return k >> 1;
+}
+
+template <typename T, typename Compare>
+template <typename K>
+bool FrozenBST<T, Compare>::find_(const K& value, unsigned& compares) const {
+    compares = 0;
+    size_t k = lowerBoundSlot_(value, compares);
+    if (k == 0 || compare_(value, data_[k - 1]))
+        return false;
+
+    // a BST::find() would have stopped at the value, at depth(k) + 1
+    compares = 0;
+    for (; k != 0; k >>= 1)
+        ++compares;
+    return true;
+}
+
+template <typename T, typename Compare>
+FrozenBST<T, Compare> freeze(const BST<T, Compare>& tree) {
+    return FrozenBST<T, Compare>(tree);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file FrozenBST.h
+ * @author Chek
+ * @brief FrozenBST class definition
+ *        An immutable snapshot of a BST for lookup-heavy phases
+ * @date 12 Sep 2023
+ */
+#ifndef FROZENBST_H
+#define FROZENBST_H
+#include "BST.h"
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+/**
+ * @class FrozenBST
+ * @brief An immutable, array-based snapshot of the values in a BST
+ *       The values are stored in Eytzinger (BFS) order, i.e., the node at
+ *       (1-based) slot k has its children at slots 2k and 2k + 1, so the
+ *       snapshot is a complete tree with no pointers to chase:
+ *       - the top levels of the tree share a few cache lines
+ *       - the search has no data-dependent branches, it only computes the
+ *         next slot from the result of a compare
+ *       - the descendants 4 levels (or a cache line) below the current
+ *         slot are contiguous, so they are prefetched while comparing
+ *       Changing the source tree afterwards does not change the snapshot
+ * @tparam T The type of the values
+ * @tparam Compare The comparison function object (see BST)
+ */
+template <typename T, typename Compare = std::less<T>>
+class FrozenBST {
+  public:
+    /**
+     * @brief Take a snapshot of a tree in O(n)
+     * @param tree The tree whose values are copied
+     */
+    explicit FrozenBST(const BST<T, Compare>& tree);
+
+    /**
+     * @brief Find a value in the snapshot
+     * @param value The value to be found
+     * @param compares The number of comparisons a BST::find() would make
+     *                 on the snapshot's tree, i.e., the depth of the value
+     *                 plus 1 if it is found, else the levels walked
+     * @return true if the value is found
+     */
+    bool find(const T& value, unsigned& compares) const;
+
+    /**
+     * @brief Find a value equivalent to a key of another type
+     *        Only available when Compare is transparent
+     * @param key The key to be found
+     * @param compares The number of comparisons (see above)
+     * @return true if a value equivalent to the key is found
+     */
+    template <typename K, typename C = Compare,
+              typename = typename C::is_transparent>
+    bool find(const K& key, unsigned& compares) const;
+
+    /**
+     * @brief Get the first value not less than a value
+     * @param value The value to be compared with
+     * @return The value (nullptr if all values are less)
+     */
+    const T* lowerBound(const T& value) const;
+
+    /**
+     * @brief Check if the snapshot is empty
+     * @return true if the snapshot is empty
+     */
+    bool empty() const;
+
+    /**
+     * @brief Get the number of values in the snapshot
+     * @return The number of values
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Get the values in Eytzinger order (slot k is at index k - 1)
+     * @return The values
+     */
+    const std::vector<T>& data() const;
+
+  private:
+
+    // the values in Eytzinger order, with slot k at index k - 1
+    std::vector<T> data_;
+
+    // orders the values (copied from the source tree)
+    Compare compare_;
+
+    // the number of values prefetched together, i.e., a cache line's worth
+    static const size_t PREFETCH_STRIDE = sizeof(T) < 64 ? 64 / sizeof(T) : 1;
+
+    /**
+     * @brief A branchless step to find the slot of the first value not less
+     *        than a value
+     * @param value The value (or key) to be compared with
+     * @param levels The number of levels walked (a reference as output)
+     * @return The 1-based slot (0 if all values are less)
+     */
+    template <typename K>
+    size_t lowerBoundSlot_(const K& value, unsigned& levels) const;
+
+    /**
+     * @brief A step to find a value and count the compares like BST::find()
+     * @param value The value (or key) to be found
+     * @param compares The number of comparisons (a reference as output)
+     * @return true if the value is found
+     */
+    template <typename K>
+    bool find_(const K& value, unsigned& compares) const;
+};
+
+/**
+ * @brief Take an immutable snapshot of a tree for fast lookups
+ * @param tree The tree to be frozen
+ * @return The snapshot
+ */
+template <typename T, typename Compare>
+FrozenBST<T, Compare> freeze(const BST<T, Compare>& tree);
+
+// include the implementation as FrozenBST is a templated class (see BST.h)
+#include "FrozenBST.cpp"
+
+#endif
@@ -0,0 +1,354 @@
+/**
+ * @file MultiWriterBST.cpp
+ * @author Chek
+ * @brief MultiWriterBST class implementation
+ *        This file is included by MultiWriterBST.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "MultiWriterBST.h"
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template <typename T, typename Compare>
+MultiWriterBST<T, Compare>::Node::Node(const T& value)
+    : left(nullptr), right(nullptr), data(value), count(0), isLive(true) {}
+
+template <typename T, typename Compare>
+MultiWriterBST<T, Compare>::MultiWriterBST(SimpleAllocator* allocator,
+                                           const Compare& compare)
+    : root_(nullptr), allocator_(allocator), isOwnAllocator_(false),
+      compare_(compare), countedChanges_(0) {
+    for (Counter& counter : counters_) {
+        counter.values.store(0, std::memory_order_relaxed);
+        counter.changes.store(0, std::memory_order_relaxed);
+    }
+    if (allocator_ == nullptr) {
+        // every thread allocates from its own cache, taking the lock only
+        // to refill or flush it
+        SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES,
+                                     SimpleAllocatorConfig::HeaderBlockInfo(),
+                                     0, 0, false, true);
+        allocator_ = new SimpleAllocator(sizeof(Node), config);
+        isOwnAllocator_ = true;
+    }
+}
+
+template <typename T, typename Compare>
+MultiWriterBST<T, Compare>::~MultiWriterBST() {
+    clear();
+    if (isOwnAllocator_)
+        delete allocator_;
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::add(const T& value) {
+    Node* node = nullptr;
+    std::atomic<Node*>* link = &root_;
+    for (;;) {
+        Node* current = link->load(std::memory_order_acquire);
+        if (current == nullptr) {
+            if (node == nullptr) {
+                void* mem = nullptr;
+                try {
+                    mem = allocator_->allocate();
+                } catch (const SimpleAllocatorException& e) {
+                    throw BSTException(BSTException::E_NO_MEMORY, e.what());
+                }
+                try {
+                    node = new (mem) Node(value);
+                } catch (...) {
+                    allocator_->free(mem);
+                    throw;
+                }
+            }
+
+            // the link is still empty, so nothing can go between the node
+            // above and the value: link the node there
+            if (link->compare_exchange_strong(current, node, std::memory_order_release,
+                                              std::memory_order_acquire))
+                break;
+
+            // another thread linked a node first: carry on from that one
+        }
+
+        if (compare_(value, current->data))
+            link = &current->left;
+        else if (compare_(current->data, value))
+            link = &current->right;
+        else {
+            // the value has a node already, which may have been removed
+            if (node != nullptr) {
+                node->~Node();
+                allocator_->free(node);
+            }
+            bool isLive = false;
+            if (!current->isLive.compare_exchange_strong(isLive, true))
+                throw BSTException(BSTException::E_DUPLICATE,
+                                   "Value to add already exists in the tree");
+            break;
+        }
+    }
+
+    countChange(1);
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::remove(const T& value) {
+    Node* current = root_.load(std::memory_order_acquire);
+    while (current != nullptr) {
+        if (compare_(value, current->data))
+            current = current->left.load(std::memory_order_acquire);
+        else if (compare_(current->data, value))
+            current = current->right.load(std::memory_order_acquire);
+        else
+            break;
+    }
+
+    // only one of the threads removing the value gets to mark it
+    bool isLive = true;
+    if (current == nullptr || !current->isLive.compare_exchange_strong(isLive, false))
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+
+    countChange(-1);
+}
+
+template <typename T, typename Compare>
+bool MultiWriterBST<T, Compare>::find(const T& value, unsigned& compares) const {
+    compares = 0;
+    const Node* current = root_.load(std::memory_order_acquire);
+    while (current != nullptr) {
+        ++compares;
+        if (compare_(value, current->data))
+            current = current->left.load(std::memory_order_acquire);
+        else if (compare_(current->data, value))
+            current = current->right.load(std::memory_order_acquire);
+        else
+            return current->isLive.load();
+    }
+
+    // reached the end without finding the value
+    return false;
+}
+
+template <typename T, typename Compare>
+const T* MultiWriterBST<T, Compare>::operator[](int index) const {
+    if (countedChanges_.load() != changes()) {
+        // one recount at a time, so a late recount cannot store its counts
+        // over those of a later one
+        std::lock_guard<std::mutex> lock(recountMutex_);
+        uint64_t counted = countedChanges_.load();
+        uint64_t before = changes();
+        if (counted != before) {
+            recount();
+
+            // the counts are only trusted if no change was made during the
+            // recount, otherwise the next call recounts again
+            if (changes() == before)
+                countedChanges_.compare_exchange_strong(counted, before);
+        }
+    }
+
+    const Node* current = index >= 0 ? root_.load(std::memory_order_acquire) : nullptr;
+    while (current != nullptr) {
+        // L is the number of values in the left subtree, and removed nodes
+        // hold no value themselves
+        const Node* left = current->left.load(std::memory_order_acquire);
+        int L = left == nullptr ? 0 : static_cast<int>(left->count.load());
+        int self = current->isLive.load() ? 1 : 0;
+        if (L > index)
+            current = left;
+        else if (L + self > index)
+            return &current->data;
+        else {
+            index -= L + self;
+            current = current->right.load(std::memory_order_acquire);
+        }
+    }
+
+    throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+}
+
+template <typename T, typename Compare>
+unsigned MultiWriterBST<T, Compare>::size() const {
+    int values = 0;
+    for (const Counter& counter : counters_)
+        values += counter.values.load(std::memory_order_relaxed);
+
+    // a remove can be counted before the add it undoes while both are in flight
+    return values < 0 ? 0 : static_cast<unsigned>(values);
+}
+
+template <typename T, typename Compare>
+int MultiWriterBST<T, Compare>::height() const {
+    // an empty tree has a height of -1 so that a leaf has a height of 0
+    int height = -1;
+    std::vector<std::pair<const Node*, int>> stack;
+    if (root_.load() != nullptr)
+        stack.push_back(std::make_pair(root_.load(), 0));
+    while (!stack.empty()) {
+        const Node* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        for (; node != nullptr; node = node->left.load(), ++depth) {
+            if (depth > height)
+                height = depth;
+            if (node->right.load() != nullptr)
+                stack.push_back(std::make_pair(node->right.load(), depth + 1));
+        }
+    }
+
+    return height;
+}
+
+template <typename T, typename Compare>
+unsigned MultiWriterBST<T, Compare>::removedNodes() const {
+    unsigned removed = 0;
+    forEachNode([&removed](const Node* node) { removed += !node->isLive.load(); });
+    return removed;
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::compact() {
+    // take the nodes in sorted order, freeing the removed ones
+    std::vector<Node*> live;
+    std::vector<Node*> stack;
+    Node* node = root_.load();
+    while (node != nullptr || !stack.empty()) {
+        for (; node != nullptr; node = node->left.load())
+            stack.push_back(node);
+        node = stack.back();
+        stack.pop_back();
+        Node* right = node->right.load();
+        if (node->isLive.load())
+            live.push_back(node);
+        else {
+            // destroy the node explicitly as it was constructed with placement new
+            node->~Node();
+            allocator_->free(node);
+        }
+        node = right;
+    }
+
+    // no other thread is in the tree, so its links can be set again
+    root_.store(linkBalanced(live, 0, live.size()));
+    countedChanges_.store(changes());
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::clear() {
+    for (Counter& counter : counters_) {
+        counter.values.store(0);
+        counter.changes.store(0);
+    }
+    countedChanges_.store(0);
+
+    // an allocator owned by the tree only holds our nodes,
+    // so all its pages can be released in one go
+    if (isOwnAllocator_ && std::is_trivially_destructible<T>::value) {
+        root_.store(nullptr);
+        allocator_->freeAll();
+        return;
+    }
+
+    forEachNode([this](const Node* node) {
+        // destroy the node explicitly as it was constructed with placement new
+        node->~Node();
+        allocator_->free(const_cast<Node*>(node));
+    });
+    root_.store(nullptr);
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::countChange(int delta) {
+    // start each thread on its own counter so that writers rarely share one
+    static thread_local const unsigned index = static_cast<unsigned>(
+        std::hash<std::thread::id>()(std::this_thread::get_id()));
+    Counter& counter = counters_[index % MULTI_WRITER_BST_COUNTERS];
+
+    // the change is released with the count, so a reader that sees the
+    // count (see operator[]) sees the change too
+    counter.values.fetch_add(delta, std::memory_order_relaxed);
+    counter.changes.fetch_add(1, std::memory_order_release);
+}
+
+template <typename T, typename Compare>
+uint64_t MultiWriterBST<T, Compare>::changes() const {
+    uint64_t changes = 0;
+    for (const Counter& counter : counters_)
+        changes += counter.changes.load(std::memory_order_acquire);
+    return changes;
+}
+
+template <typename T, typename Compare>
+void MultiWriterBST<T, Compare>::recount() const {
+    // post-order, so both children are counted before the node
+    // - a node is pushed twice, the second time once its children are in
+    std::vector<std::pair<const Node*, bool>> stack;
+    if (root_.load(std::memory_order_acquire) != nullptr)
+        stack.push_back(std::make_pair(root_.load(std::memory_order_acquire), false));
+    while (!stack.empty()) {
+        const Node* node = stack.back().first;
+        bool isChildrenCounted = stack.back().second;
+        stack.pop_back();
+        const Node* left = node->left.load(std::memory_order_acquire);
+        const Node* right = node->right.load(std::memory_order_acquire);
+        if (!isChildrenCounted) {
+            stack.push_back(std::make_pair(node, true));
+            if (left != nullptr)
+                stack.push_back(std::make_pair(left, false));
+            if (right != nullptr)
+                stack.push_back(std::make_pair(right, false));
+            continue;
+        }
+
+        // a child linked since it was pushed has a count of its own subtree
+        // that may be behind, which only a change in flight can cause
+        unsigned count = node->isLive.load() ? 1 : 0;
+        if (left != nullptr)
+            count += left->count.load(std::memory_order_relaxed);
+        if (right != nullptr)
+            count += right->count.load(std::memory_order_relaxed);
+        node->count.store(count, std::memory_order_relaxed);
+    }
+}
+
+template <typename T, typename Compare>
+typename MultiWriterBST<T, Compare>::Node*
+MultiWriterBST<T, Compare>::linkBalanced(const std::vector<Node*>& nodes,
+                                         size_t begin, size_t end) {
+    if (begin == end)
+        return nullptr;
+
+    // the middle node is the root, with the runs either side below it
+    size_t middle = begin + (end - begin) / 2;
+    Node* node = nodes[middle];
+    node->left.store(linkBalanced(nodes, begin, middle));
+    node->right.store(linkBalanced(nodes, middle + 1, end));
+    node->count.store(static_cast<unsigned>(end - begin));
+    return node;
+}
+
+template <typename T, typename Compare>
+template <typename Visit>
+void MultiWriterBST<T, Compare>::forEachNode(Visit visit) const {
+    // depth-first, taking the children before visiting the node
+    std::vector<Node*> stack;
+    if (root_.load() != nullptr)
+        stack.push_back(root_.load());
+    while (!stack.empty()) {
+        Node* node = stack.back();
+        stack.pop_back();
+        if (node->left.load() != nullptr)
+            stack.push_back(node->left.load());
+        if (node->right.load() != nullptr)
+            stack.push_back(node->right.load());
+        visit(node);
+    }
+}
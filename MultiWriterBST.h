@@ -0,0 +1,234 @@
+/**
+ * @file MultiWriterBST.h
+ * @author Chek
+ * @brief MultiWriterBST class definition
+ *        A BST that many threads can add to, remove from and read at once
+ * @date 12 Sep 2023
+ */
+#ifndef MULTIWRITERBST_H
+#define MULTIWRITERBST_H
+#include "BST.h" // for BSTException and the allocator defaults
+#include "SimpleAllocator.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+// The number of counters a MultiWriterBST spreads its changes over, so that
+// threads adding and removing at once rarely write to the same one
+static const unsigned MULTI_WRITER_BST_COUNTERS = 64;
+
+/**
+ * @class MultiWriterBST
+ * @brief A Binary Search Tree with the same ordering and duplicates rule
+ *       as BST, where add(), remove(), find() and operator[] can all be
+ *       called from any number of threads at once, and only a recount in
+ *       operator[] takes a lock
+ *       - a link only ever goes from empty to a node, so a node never moves
+ *         and an add that finds its empty link taken carries on from the
+ *         node that took it (optimistic validation with one CAS)
+ *       - remove() only marks the node as removed, leaving it in place to
+ *         route the searches below it, and add() brings a removed node back
+ *         to life, so writers in different subtrees never touch the same
+ *         node
+ *       - a change is counted on the writer's own counter rather than on
+ *         the path from the root, and size() adds the counters up
+ *       - the subtree counts are only brought up to date by operator[],
+ *         which recounts the tree (O(n), one thread at a time under a
+ *         mutex) when a change has been made since the last recount, so it
+ *         suits phases of lookups between phases of writes; operator[] and
+ *         size() are exact whenever no write is in flight
+ *       - removed nodes stay until compact() or clear(), which need every
+ *         other thread to be out of the tree, so without them the memory
+ *         used grows with the number of different values ever added (a
+ *         hard limit for churn over ever new values)
+ *       - the tree is not balanced until compact() rebuilds it, so it suits
+ *         keys that are added in a random order
+ * @tparam T The type of the values (copy constructible)
+ * @tparam Compare The comparison function object (see BST)
+ */
+template <typename T, typename Compare = std::less<T>>
+class MultiWriterBST {
+  public:
+    /**
+     * @struct Node
+     * @brief A node in the tree (its data never changes once it is linked)
+     */
+    struct Node {
+        // left and right child pointers (only ever set once)
+        std::atomic<Node*> left;
+        std::atomic<Node*> right;
+
+        // the data stored in the node
+        const T data;
+
+        // the number of values in the subtree rooted at this node that are
+        // not removed, as of the last recount (see operator[])
+        mutable std::atomic<unsigned> count;
+
+        // whether the value is in the tree (false once it is removed)
+        std::atomic<bool> isLive;
+
+        /**
+         * @brief Constructor
+         * @param value The value to be stored
+         */
+        explicit Node(const T& value);
+    };
+
+    /**
+     * @brief Default constructor
+     * @param allocator The allocator for the nodes, which must be thread-safe
+     *                  (one with thread caches is created if none is given)
+     * @param compare The comparison function object to order the values
+     */
+    MultiWriterBST(SimpleAllocator* allocator = nullptr,
+                   const Compare& compare = Compare());
+
+    /**
+     * @brief Destructor
+     *        No thread may be using the tree
+     */
+    ~MultiWriterBST();
+
+    /**
+     * @brief Add a value to the tree (for any thread)
+     * @param value The value to be added
+     * @throws BSTException E_DUPLICATE if the value is already in the tree,
+     *         E_NO_MEMORY if the allocator runs out
+     */
+    void add(const T& value);
+
+    /**
+     * @brief Remove a value from the tree (for any thread)
+     * @param value The value to be removed
+     * @throws BSTException E_NOT_FOUND if the value is not in the tree
+     */
+    void remove(const T& value);
+
+    /**
+     * @brief Find a value in the tree (for any thread)
+     * @param value The value to be found
+     * @param compares The number of comparisons made (an output)
+     * @return true if the value is found
+     */
+    bool find(const T& value, unsigned& compares) const;
+
+    /**
+     * @brief Get the value at an index in the sorted order (for any thread)
+     *        The subtree counts are recounted first (O(n)) if the tree has
+     *        changed since they last were
+     *        The value stays readable until compact() or clear(), even if
+     *        it is removed
+     * @param index The index of the value (0 for the smallest)
+     * @return A pointer to the value
+     * @throws BSTException E_OUT_BOUNDS if the index is out of range (as
+     *         for BST)
+     */
+    const T* operator[](int index) const;
+
+    /**
+     * @brief Get the number of values in the tree
+     * @return The number of values
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Get the height of the tree, counting removed nodes (O(n))
+     * @return The height (-1 for an empty tree, 0 for a single node)
+     */
+    int height() const;
+
+    /**
+     * @brief Get the number of removed nodes still in the tree (O(n))
+     * @return The number of removed nodes
+     */
+    unsigned removedNodes() const;
+
+    /**
+     * @brief Free the removed nodes and relink the others as a balanced tree
+     *        No other thread may be using the tree
+     */
+    void compact();
+
+    /**
+     * @brief Remove all values and free all nodes
+     *        No other thread may be using the tree
+     */
+    void clear();
+
+  private:
+    // Disable copy constructor and assignment operator
+    MultiWriterBST(const MultiWriterBST&) = delete;
+    MultiWriterBST& operator=(const MultiWriterBST&) = delete;
+
+    // the root of the tree (set once, like the child links)
+    std::atomic<Node*> root_;
+
+    // the allocator for the nodes and whether the tree owns it
+    SimpleAllocator* allocator_;
+    bool isOwnAllocator_;
+
+    // orders the values, i.e., compare_(a, b) is true if a goes before b
+    Compare compare_;
+
+    /**
+     * @struct Counter
+     * @brief The values added less those removed, and the number of changes,
+     *        by the threads that share the counter, on a cache line of its
+     *        own so that writers do not share lines
+     */
+    struct alignas(64) Counter {
+        std::atomic<int> values;
+        std::atomic<uint64_t> changes;
+    };
+
+    // the counters, each thread using the one its id hashes to
+    Counter counters_[MULTI_WRITER_BST_COUNTERS];
+
+    // the number of changes the subtree counts were last recounted at
+    mutable std::atomic<uint64_t> countedChanges_;
+
+    // lets one recount run at a time (see operator[])
+    mutable std::mutex recountMutex_;
+
+    /**
+     * @brief Count a change on the calling thread's counter
+     * @param delta 1 for a value added or brought back, -1 for one removed
+     */
+    void countChange(int delta);
+
+    /**
+     * @brief Get the number of changes made so far (over all the counters)
+     * @return The number of changes
+     */
+    uint64_t changes() const;
+
+    /**
+     * @brief Bring every subtree count up to date (O(n), for any thread)
+     *        Concurrent recounts of an unchanging tree store the same counts
+     */
+    void recount() const;
+
+    /**
+     * @brief Link a sorted run of nodes as a balanced subtree, with counts
+     * @param nodes The nodes in sorted order
+     * @param begin The index of the first node of the run
+     * @param end The index one past the last node of the run
+     * @return The root of the subtree (nullptr for an empty run)
+     */
+    static Node* linkBalanced(const std::vector<Node*>& nodes, size_t begin, size_t end);
+
+    /**
+     * @brief Call a function on every node
+     * @param visit The function, which may free the node it is given
+     */
+    template <typename Visit>
+    void forEachNode(Visit visit) const;
+};
+
+// include the implementation as MultiWriterBST is a templated class (see BST.h)
+#include "MultiWriterBST.cpp"
+
+#endif
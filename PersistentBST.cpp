@@ -0,0 +1,339 @@
+/**
+ * @file PersistentBST.cpp
+ * @author Chek
+ * @brief PersistentBST class implementation
+ *        This file is included by PersistentBST.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "PersistentBST.h"
+#include <new>
+#include <utility>
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>::Node::Node(Node* l, Node* r, const T& value, unsigned n)
+    : left(l), right(r), data(value), count(n), refs(1) {}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>::PersistentBST(SimpleAllocator* allocator,
+                                         const Compare& compare)
+    : root_(nullptr), allocator_(allocator), ownAllocator_(), compare_(compare) {
+    if (allocator_ == nullptr) {
+        // snapshots may be destroyed on other threads, so every thread
+        // frees into its own cache, taking the lock only to flush it
+        SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES,
+                                     SimpleAllocatorConfig::HeaderBlockInfo(),
+                                     0, 0, false, true);
+        ownAllocator_ = std::make_shared<SimpleAllocator>(sizeof(Node), config);
+        allocator_ = ownAllocator_.get();
+    }
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>::PersistentBST(const PersistentBST& rhs)
+    : root_(rhs.root_), allocator_(rhs.allocator_),
+      ownAllocator_(rhs.ownAllocator_), compare_(rhs.compare_) {
+    retain(root_);
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>::PersistentBST(PersistentBST&& rhs) noexcept
+    : root_(rhs.root_), allocator_(rhs.allocator_),
+      ownAllocator_(rhs.ownAllocator_), compare_(rhs.compare_) {
+    // rhs is left empty but keeps sharing the allocator
+    rhs.root_ = nullptr;
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>&
+PersistentBST<T, Compare>::operator=(const PersistentBST& rhs) {
+    // share the new nodes before letting go of ours, in case they are the same
+    retain(rhs.root_);
+    release(root_);
+    root_ = rhs.root_;
+    allocator_ = rhs.allocator_;
+    ownAllocator_ = rhs.ownAllocator_;
+    compare_ = rhs.compare_;
+    return *this;
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>&
+PersistentBST<T, Compare>::operator=(PersistentBST&& rhs) noexcept {
+    if (this == &rhs)
+        return *this;
+
+    release(root_);
+    root_ = rhs.root_;
+    rhs.root_ = nullptr;
+    allocator_ = rhs.allocator_;
+    ownAllocator_ = rhs.ownAllocator_;
+    compare_ = rhs.compare_;
+    return *this;
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare>::~PersistentBST() {
+    // the allocator itself goes with the last tree that shares it
+    release(root_);
+}
+
+template <typename T, typename Compare>
+PersistentBST<T, Compare> PersistentBST<T, Compare>::snapshot() const {
+    return PersistentBST(*this);
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::add(const T& value) {
+    if (!tryAdd(value))
+        throw BSTException(BSTException::E_DUPLICATE,
+                           "Value to add already exists in the tree");
+}
+
+template <typename T, typename Compare>
+bool PersistentBST<T, Compare>::tryAdd(const T& value) {
+    if (*findLink(value) != nullptr)
+        return false;
+
+    // make the node first, so that a failure to copy the path can free it
+    Node* node = makeNode(nullptr, nullptr, value, 1);
+    try {
+        unsharePath();
+    } catch (...) {
+        release(node);
+        throw;
+    }
+
+    // only reached once the path is ours, so the subtrees on it grew
+    *path_.back() = node;
+    for (size_t i = 0; i + 1 < path_.size(); ++i)
+        ++(*path_[i])->count;
+    return true;
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::remove(const T& value) {
+    if (!tryRemove(value))
+        throw BSTException(BSTException::E_NOT_FOUND,
+                           "Value to remove not found in the tree");
+}
+
+template <typename T, typename Compare>
+bool PersistentBST<T, Compare>::tryRemove(const T& value) {
+    Node** link = findLink(value);
+    if (*link == nullptr)
+        return false;
+
+    // two children: the predecessor's value replaces the value and the
+    // predecessor's node goes instead, so its path is changed too
+    size_t found = path_.size() - 1;
+    if ((*link)->left != nullptr && (*link)->right != nullptr) {
+        link = &(*link)->left;
+        path_.push_back(link);
+        while ((*link)->right != nullptr) {
+            link = &(*link)->right;
+            path_.push_back(link);
+        }
+    }
+    unsharePath();
+
+    // only reached once the path is ours, so the subtrees above the node
+    // that goes shrank
+    for (size_t i = 0; i + 1 < path_.size(); ++i)
+        --(*path_[i])->count;
+
+    // the node that goes has at most one child now, which takes its place
+    // - it is ours alone, so its value can be moved out
+    Node* node = *path_.back();
+    if (path_.size() - 1 != found)
+        (*path_[found])->data = std::move(node->data);
+    Node* child = node->left != nullptr ? node->left : node->right;
+    retain(child);
+    *path_.back() = child;
+    release(node);
+    return true;
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::clear() {
+    release(root_);
+    root_ = nullptr;
+}
+
+template <typename T, typename Compare>
+bool PersistentBST<T, Compare>::find(const T& value, unsigned& compares) const {
+    compares = 0;
+    const Node* current = root_;
+    while (current != nullptr) {
+        ++compares;
+        if (compare_(value, current->data))
+            current = current->left;
+        else if (compare_(current->data, value))
+            current = current->right;
+        else
+            return true;
+    }
+
+    // reached the end without finding the value
+    return false;
+}
+
+template <typename T, typename Compare>
+const T& PersistentBST<T, Compare>::operator[](int index) const {
+    const Node* current = root_;
+    if (index >= 0) {
+        while (current != nullptr) {
+            // L is the number of nodes in the left subtree
+            int L = static_cast<int>(size_(current->left));
+            if (L > index)
+                current = current->left;
+            else if (L < index) {
+                index -= L + 1;
+                current = current->right;
+            } else
+                return current->data;
+        }
+    }
+
+    throw BSTException(BSTException::E_OUT_BOUNDS, "Index out of bounds");
+}
+
+template <typename T, typename Compare>
+bool PersistentBST<T, Compare>::empty() const {
+    return root_ == nullptr;
+}
+
+template <typename T, typename Compare>
+unsigned PersistentBST<T, Compare>::size() const {
+    return size_(root_);
+}
+
+template <typename T, typename Compare>
+int PersistentBST<T, Compare>::height() const {
+    // an empty tree has a height of -1 so that a leaf has a height of 0
+    int height = -1;
+    std::vector<std::pair<const Node*, int>> stack;
+    if (root_ != nullptr)
+        stack.push_back(std::make_pair(root_, 0));
+    while (!stack.empty()) {
+        const Node* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        for (; node != nullptr; node = node->left, ++depth) {
+            if (depth > height)
+                height = depth;
+            if (node->right != nullptr)
+                stack.push_back(std::make_pair(node->right, depth + 1));
+        }
+    }
+
+    return height;
+}
+
+template <typename T, typename Compare>
+typename PersistentBST<T, Compare>::Node**
+PersistentBST<T, Compare>::findLink(const T& value) {
+    path_.clear();
+
+    Node** link = &root_;
+    path_.push_back(link);
+    while (*link != nullptr) {
+        Node* node = *link;
+        if (compare_(value, node->data))
+            link = &node->left;
+        else if (compare_(node->data, value))
+            link = &node->right;
+        else
+            break;
+        path_.push_back(link);
+    }
+
+    return link;
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::unsharePath() {
+    for (size_t i = 0; i < path_.size(); ++i) {
+        // a node linked from one place is ours, as the path above it is
+        Node* node = *path_[i];
+        if (node == nullptr || node->refs.load(std::memory_order_acquire) == 1)
+            continue;
+
+        // swap in a copy, moving the next link over to it
+        Node* copy = makeNode(node->left, node->right, node->data, node->count);
+        *path_[i] = copy;
+        if (i + 1 < path_.size())
+            path_[i + 1] = path_[i + 1] == &node->left ? &copy->left : &copy->right;
+        release(node);
+    }
+}
+
+template <typename T, typename Compare>
+typename PersistentBST<T, Compare>::Node*
+PersistentBST<T, Compare>::makeNode(Node* left, Node* right, const T& data,
+                                    unsigned count) {
+    void* mem = nullptr;
+    try {
+        mem = allocator_->allocate();
+    } catch (const SimpleAllocatorException& e) {
+        throw BSTException(BSTException::E_NO_MEMORY, e.what());
+    }
+
+    // construct the node in place, giving the memory back if T throws
+    Node* node = nullptr;
+    try {
+        node = new (mem) Node(left, right, data, count);
+    } catch (...) {
+        allocator_->free(mem);
+        throw;
+    }
+
+    // the children are now also linked from the new node
+    retain(left);
+    retain(right);
+    return node;
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::retain(Node* node) {
+    // a new link is made from one that is already counted, so nothing can
+    // free the node in between and the increment need not be ordered
+    if (node != nullptr)
+        node->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename T, typename Compare>
+void PersistentBST<T, Compare>::release(Node* node) {
+    // the last link to go frees the node, after every change made through
+    // the other links (as for std::shared_ptr)
+    if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // the links of a freed node go too, which may free its children
+    // - freed nodes wait on a stack for their right child to be let go
+    //   of, linked through their left field once their left child has
+    //   been, so the walk takes no memory of its own
+    Node* stack = nullptr;
+    while (node != nullptr || stack != nullptr) {
+        while (node != nullptr) {
+            Node* left = node->left;
+            node->left = stack;
+            stack = node;
+            node = left != nullptr &&
+                   left->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 ? left : nullptr;
+        }
+
+        Node* top = stack;
+        stack = top->left;
+        Node* right = top->right;
+        top->~Node();
+        allocator_->free(top);
+        node = right != nullptr &&
+               right->refs.fetch_sub(1, std::memory_order_acq_rel) == 1 ? right : nullptr;
+    }
+}
+
+template <typename T, typename Compare>
+unsigned PersistentBST<T, Compare>::size_(const Node* node) {
+    return node == nullptr ? 0 : node->count;
+}
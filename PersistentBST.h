@@ -0,0 +1,262 @@
+/**
+ * @file PersistentBST.h
+ * @author Chek
+ * @brief PersistentBST class definition
+ *        A BST whose snapshots share their nodes with it
+ * @date 12 Sep 2023
+ */
+#ifndef PERSISTENTBST_H
+#define PERSISTENTBST_H
+#include "BST.h" // for BSTException and the allocator defaults
+#include "SimpleAllocator.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @class PersistentBST
+ * @brief A Binary Search Tree with the same ordering and duplicates rule
+ *       as BST, where snapshot() (and the copy constructor) takes an O(1)
+ *       copy that shares every node with the tree
+ *       - each node counts the trees and nodes that link to it, and a node
+ *         linked from more than one place is never changed: add() and
+ *         remove() copy the shared nodes on the path they change (copying
+ *         a node shares its children in turn), so a snapshot only costs
+ *         the nodes that later changes copy
+ *       - nodes that only one tree can reach are changed in place, so a
+ *         tree without snapshots does not copy anything
+ *       - each tree is used by one thread at a time, but a snapshot can be
+ *         read and destroyed on another thread while the tree it was taken
+ *         from changes, as long as the allocator is thread safe (the one
+ *         it creates uses thread caches)
+ *       - it is not a balanced tree
+ * @tparam T The type of the values (copy constructible)
+ * @tparam Compare The comparison function object (see BST)
+ */
+template <typename T, typename Compare = std::less<T>>
+class PersistentBST {
+  public:
+    /**
+     * @struct Node
+     * @brief A node in the tree, shared by the trees that can reach it
+     */
+    struct Node {
+        /**
+         * @brief Construct a node that is linked from one place
+         * @param l The left child
+         * @param r The right child
+         * @param value The value
+         * @param n The number of nodes in its subtree
+         */
+        Node(Node* l, Node* r, const T& value, unsigned n);
+
+        // left and right child pointers
+        Node* left;
+        Node* right;
+
+        // the data stored in the node
+        T data;
+
+        // the number of nodes in the subtree rooted at this node
+        unsigned count;
+
+        // the number of trees and nodes that link to this node
+        std::atomic<unsigned> refs;
+    };
+
+    /**
+     * @brief Default constructor
+     * @param allocator The allocator for the nodes, shared with the
+     *                  snapshots (one is created if none is given)
+     * @param compare The comparison function object to order the values
+     */
+    PersistentBST(SimpleAllocator* allocator = nullptr,
+                  const Compare& compare = Compare());
+
+    /**
+     * @brief Copy constructor
+     *        It shares every node of rhs in O(1) (see snapshot())
+     * @param rhs The tree to be copied
+     */
+    PersistentBST(const PersistentBST& rhs);
+
+    /**
+     * @brief Move constructor
+     *        It takes over the nodes of rhs, leaving rhs empty
+     * @param rhs The tree to be moved from
+     */
+    PersistentBST(PersistentBST&& rhs) noexcept;
+
+    /**
+     * @brief Assignment operator
+     *        It lets go of our nodes and shares every node of rhs
+     * @param rhs The tree to be copied
+     */
+    PersistentBST& operator=(const PersistentBST& rhs);
+
+    /**
+     * @brief Move assignment operator
+     * @param rhs The tree to be moved from
+     */
+    PersistentBST& operator=(PersistentBST&& rhs) noexcept;
+
+    /**
+     * @brief Destructor
+     *        Only the nodes that no other tree shares are freed
+     */
+    ~PersistentBST();
+
+    /**
+     * @brief Take a copy of the tree in O(1) that later changes to either
+     *        tree do not show in the other
+     * @return The snapshot, which shares the allocator of the tree
+     */
+    PersistentBST snapshot() const;
+
+    /**
+     * @brief Add a value to the tree
+     * @param value The value to be added
+     * @throws BSTException E_DUPLICATE if the value is already in the tree,
+     *         E_NO_MEMORY if the allocator runs out (the values are unchanged)
+     */
+    void add(const T& value);
+
+    /**
+     * @brief Add a value to the tree unless it already exists
+     *        A duplicate does not allocate or copy any node
+     * @param value The value to be added
+     * @return true if the value was added, false if it already exists
+     * @throws BSTException E_NO_MEMORY if the allocator runs out
+     */
+    bool tryAdd(const T& value);
+
+    /**
+     * @brief Remove a value from the tree
+     * @param value The value to be removed
+     * @throws BSTException E_NOT_FOUND if the value is not in the tree,
+     *         E_NO_MEMORY if the allocator runs out (the values are unchanged)
+     */
+    void remove(const T& value);
+
+    /**
+     * @brief Remove a value from the tree if it exists
+     *        A miss does not allocate or copy any node
+     * @param value The value to be removed
+     * @return true if the value was removed, false if it does not exist
+     * @throws BSTException E_NO_MEMORY if the allocator runs out
+     */
+    bool tryRemove(const T& value);
+
+    /**
+     * @brief Let go of every node, freeing the ones no other tree shares
+     */
+    void clear();
+
+    /**
+     * @brief Find a value in the tree
+     * @param value The value to be found
+     * @param compares The number of comparisons made (an output)
+     * @return true if the value is found
+     */
+    bool find(const T& value, unsigned& compares) const;
+
+    /**
+     * @brief Get the value at an index in the sorted order
+     * @param index The index of the value (0 for the smallest)
+     * @return The value, valid until the tree changes
+     * @throws BSTException E_OUT_BOUNDS if the index is out of range
+     */
+    const T& operator[](int index) const;
+
+    /**
+     * @brief Check if the tree is empty
+     * @return true if the tree has no values
+     */
+    bool empty() const;
+
+    /**
+     * @brief Get the number of values in the tree
+     * @return The number of values
+     */
+    unsigned size() const;
+
+    /**
+     * @brief Get the height of the tree (O(n))
+     * @return The height (-1 for an empty tree, 0 for a single node)
+     */
+    int height() const;
+
+  private:
+    // the root of the tree
+    Node* root_;
+
+    // the allocator for the nodes, and the one we created (if any), which
+    // goes with the last tree or snapshot that uses it
+    SimpleAllocator* allocator_;
+    std::shared_ptr<SimpleAllocator> ownAllocator_;
+
+    // orders the values, i.e., compare_(a, b) is true if a goes before b
+    Compare compare_;
+
+    // the links walked by the last add or remove
+    // - kept as a member so that its storage is reused between calls
+    std::vector<Node**> path_;
+
+    /**
+     * @brief Walk down to the link where a value is or would go
+     *        The links walked, from the root down to and including the
+     *        returned one, are recorded in path_ (top-down)
+     * @param value The value to look for
+     * @return The link to the node holding the value, or the empty link
+     *         it would be added to
+     */
+    Node** findLink(const T& value);
+
+    /**
+     * @brief Make the nodes on path_ ours alone, top-down, so that they can
+     *        be changed in place
+     *        A shared node is replaced by a copy that shares its children,
+     *        and the next link in path_ is moved over to the copy
+     *        It is done before any count or link is changed, so a failure
+     *        leaves the same values in the tree
+     * @throws BSTException E_NO_MEMORY if the allocator runs out
+     */
+    void unsharePath();
+
+    /**
+     * @brief Make a node that shares its children
+     * @param left The left child (its count of links goes up)
+     * @param right The right child (its count of links goes up)
+     * @param data The value
+     * @param count The number of nodes in its subtree
+     * @return The node, linked from nowhere yet but counted as linked once
+     * @throws BSTException E_NO_MEMORY if the allocator runs out
+     */
+    Node* makeNode(Node* left, Node* right, const T& data, unsigned count);
+
+    /**
+     * @brief Count one link to a node more
+     * @param node The node (nothing is done for an empty tree)
+     */
+    static void retain(Node* node);
+
+    /**
+     * @brief Count one link to a node less, freeing it (and letting go of
+     *        its children in turn) if that was the last one
+     * @param node The node (nothing is done for an empty tree)
+     */
+    void release(Node* node);
+
+    /**
+     * @brief Get the number of nodes in a subtree
+     * @param node The root of the subtree
+     * @return The number of nodes (0 for an empty subtree)
+     */
+    static unsigned size_(const Node* node);
+};
+
+// include the implementation as PersistentBST is a templated class (see BST.h)
+#include "PersistentBST.cpp"
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file PolicyAllocator.cpp
+ * @author Chek
+ * @brief PolicyAllocator class implementation
+ *        This file is included by PolicyAllocator.h as the class is templated
+ * @date 12 Sep 2023
+ */
+#include "PolicyAllocator.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::PolicyAllocator(
+    size_t objectSize, unsigned objectsPerPage, unsigned maxPages)
+    : stats_(), objectsPerPage_(objectsPerPage), maxPages_(maxPages),
+      blockSize_(alignUp(DATA_OFFSET + std::max(objectSize, sizeof(Node)) + PadBytes)),
+      pageList_(nullptr), freeList_(nullptr) {
+    // | header | left pad | object | right pad | (each block rounded to the alignment)
+    stats_.objectSize = objectSize;
+    stats_.pageSize = PAGE_HEADER_SIZE + objectsPerPage_ * blockSize_;
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::~PolicyAllocator() {
+    while (pageList_ != nullptr) {
+        Node* pNext = pageList_->pNext;
+        ::operator delete(pageList_, std::align_val_t(Alignment));
+        pageList_ = pNext;
+    }
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+void* PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::allocate() {
+    // grab a new page only when there are no free blocks left
+    if (freeList_ == nullptr)
+        allocatePage();
+
+    // pop the first free block
+    Node* pObj = freeList_;
+    freeList_ = pObj->pNext;
+
+    // update stats
+    ++stats_.allocations;
+    ++stats_.objectsInUse;
+    --stats_.freeObjects;
+    stats_.mostObjects = std::max(stats_.mostObjects, stats_.objectsInUse);
+
+    if constexpr (CheckPolicy::isDebug)
+        std::memset(pObj, SimpleAllocator::ALLOCATED_PATTERN, stats_.objectSize);
+
+    if constexpr (HeaderPolicy::size > 0) {
+        // | alloc num | flag |
+        char* pHeader = reinterpret_cast<char*>(pObj) - DATA_OFFSET;
+        unsigned allocNum = static_cast<unsigned>(stats_.allocations);
+        std::memcpy(pHeader, &allocNum, sizeof(allocNum));
+        pHeader[sizeof(allocNum)] = 1;
+    }
+
+    return pObj;
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+void PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::free(void* pObj) {
+    // freeing a null pointer is a no-op, like delete
+    if (pObj == nullptr)
+        return;
+
+    if constexpr (CheckPolicy::isDebug)
+        validateFree(pObj);
+
+    if constexpr (HeaderPolicy::size > 0) {
+        char* pHeader = static_cast<char*>(pObj) - DATA_OFFSET;
+        std::memset(pHeader, 0, HeaderPolicy::size);
+    }
+
+    if constexpr (CheckPolicy::isDebug)
+        std::memset(pObj, SimpleAllocator::FREED_PATTERN, stats_.objectSize);
+
+    // push the block onto the free list
+    Node* pNode = static_cast<Node*>(pObj);
+    pNode->pNext = freeList_;
+    freeList_ = pNode;
+
+    // update stats
+    ++stats_.deallocations;
+    --stats_.objectsInUse;
+    ++stats_.freeObjects;
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+SimpleAllocatorStats PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::getStats() const {
+    return stats_;
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+void PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::allocatePage() {
+    if (maxPages_ != 0 && stats_.pagesInUse >= maxPages_)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_NO_PAGE,
+                                       "allocatePage: maximum number of pages reached");
+
+    char* pPage = nullptr;
+    try {
+        pPage = static_cast<char*>(::operator new(stats_.pageSize, std::align_val_t(Alignment)));
+    } catch (const std::bad_alloc&) {
+        throw SimpleAllocatorException(SimpleAllocatorException::E_NO_MEMORY,
+                                       "allocatePage: no memory available");
+    }
+
+    if constexpr (CheckPolicy::isDebug) {
+        std::memset(pPage, SimpleAllocator::UNALLOCATED_PATTERN, stats_.pageSize);
+        for (unsigned i = 0; i < objectsPerPage_; ++i) {
+            unsigned char* pObj =
+                reinterpret_cast<unsigned char*>(pPage) + PAGE_HEADER_SIZE + i * blockSize_ + DATA_OFFSET;
+            std::memset(pObj - PadBytes, SimpleAllocator::PAD_PATTERN, PadBytes);
+            std::memset(pObj + std::max(stats_.objectSize, sizeof(Node)), SimpleAllocator::PAD_PATTERN,
+                        PadBytes);
+        }
+    }
+
+    // link the page in front of the page list
+    Node* pPageNode = reinterpret_cast<Node*>(pPage);
+    pPageNode->pNext = pageList_;
+    pageList_ = pPageNode;
+
+    // thread the blocks onto the free list, the 1st block ending up in front
+    for (unsigned i = objectsPerPage_; i-- > 0;) {
+        char* pBlock = pPage + PAGE_HEADER_SIZE + i * blockSize_;
+        if constexpr (HeaderPolicy::size > 0)
+            std::memset(pBlock, 0, HeaderPolicy::size);
+        Node* pObj = reinterpret_cast<Node*>(pBlock + DATA_OFFSET);
+        pObj->pNext = freeList_;
+        freeList_ = pObj;
+    }
+
+    ++stats_.pagesInUse;
+    stats_.freeObjects += objectsPerPage_;
+}
+
+template <typename CheckPolicy, typename HeaderPolicy, size_t PadBytes, size_t Alignment>
+void PolicyAllocator<CheckPolicy, HeaderPolicy, PadBytes, Alignment>::validateFree(void* pObj) const {
+    char* pBlock = static_cast<char*>(pObj) - DATA_OFFSET;
+
+    // find the page the block is on and check that it is on a block boundary
+    bool isOnBoundary = false;
+    for (Node* pPage = pageList_; pPage != nullptr; pPage = pPage->pNext) {
+        char* pFirstBlock = reinterpret_cast<char*>(pPage) + PAGE_HEADER_SIZE;
+        char* pPageEnd = pFirstBlock + objectsPerPage_ * blockSize_;
+        if (pBlock >= pFirstBlock && pBlock < pPageEnd) {
+            isOnBoundary = (pBlock - pFirstBlock) % blockSize_ == 0;
+            break;
+        }
+    }
+    if (!isOnBoundary)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_BAD_BOUNDARY,
+                                       "validateFree: block is not on a block boundary");
+
+    // use the header flag if there is one, otherwise look in the free list
+    bool isFree = false;
+    if constexpr (HeaderPolicy::size > 0) {
+        isFree = pBlock[HeaderPolicy::size - 1] == 0;
+    } else {
+        for (Node* pFree = freeList_; pFree != nullptr; pFree = pFree->pNext) {
+            if (pFree == pObj) {
+                isFree = true;
+                break;
+            }
+        }
+    }
+    if (isFree)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_MULTIPLE_FREE,
+                                       "validateFree: block has already been freed");
+
+    // check that the pad bytes on both sides are untouched
+    const unsigned char* pLeftPad = static_cast<unsigned char*>(pObj) - PadBytes;
+    // (an object smaller than a Node still takes up a Node on the free list)
+    const unsigned char* pRightPad =
+        static_cast<unsigned char*>(pObj) + std::max(stats_.objectSize, sizeof(Node));
+    for (size_t i = 0; i < PadBytes; ++i) {
+        if (pLeftPad[i] != SimpleAllocator::PAD_PATTERN || pRightPad[i] != SimpleAllocator::PAD_PATTERN)
+            throw SimpleAllocatorException(SimpleAllocatorException::E_CORRUPTED_BLOCK,
+                                           "validateFree: pad bytes have been overwritten");
+    }
+}
@@ -0,0 +1,148 @@
+/**
+ * @file PolicyAllocator.h
+ * @author Chek
+ * @brief PolicyAllocator class definition
+ *        A pooled allocator like SimpleAllocator, except that the header,
+ *        pad bytes, alignment and debug checks are chosen at compile time
+ * @date 12 Sep 2023
+ */
+
+#ifndef POLICYALLOCATOR_H
+#define POLICYALLOCATOR_H
+#include "SimpleAllocator.h" // for the exceptions, stats and Node
+#include <cstddef>
+
+/**
+ * Check policy with no debug checks
+ * - allocate() and free() are a bare free list pop and push
+ */
+struct NoCheckPolicy {
+    static constexpr bool isDebug = false;
+};
+
+/**
+ * Check policy with the debug checks of SimpleAllocatorConfig::isDebug
+ * - memory is filled with the signature patterns
+ * - free() detects bad boundaries, double frees and overwritten pad bytes
+ */
+struct DebugCheckPolicy {
+    static constexpr bool isDebug = true;
+};
+
+/**
+ * Header policy with no header before each block
+ */
+struct NoHeaderPolicy {
+    static constexpr size_t size = 0;
+};
+
+/**
+ * Header policy with the layout of SimpleAllocatorConfig::BASIC_HEADER
+ * | alloc num    | flag |
+ * | unsigned int | bool |
+ */
+struct BasicHeaderPolicy {
+    static constexpr size_t size = sizeof(unsigned) + 1;
+};
+
+/**
+ * The PolicyAllocator class
+ * - the same pages of blocks threaded onto a free list as SimpleAllocator,
+ *   with every option that SimpleAllocator checks on each call made a
+ *   template parameter instead, so that the code for an option that is
+ *   not used is not even compiled in
+ * - not thread-safe
+ * @tparam CheckPolicy NoCheckPolicy or DebugCheckPolicy
+ * @tparam HeaderPolicy NoHeaderPolicy or BasicHeaderPolicy
+ * @tparam PadBytes number of pad bytes on each side of an object
+ * @tparam Alignment the boundary each object is aligned to (a power of 2)
+ */
+template <typename CheckPolicy = NoCheckPolicy, typename HeaderPolicy = NoHeaderPolicy,
+          size_t PadBytes = 0, size_t Alignment = alignof(Node)>
+class PolicyAllocator {
+public:
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of 2");
+    static_assert(Alignment >= alignof(Node), "Alignment must fit a free list Node");
+
+    /**
+     * Constructor
+     * @param objectSize object size
+     * @param objectsPerPage number of objects per page
+     * @param maxPages maximum number of pages (0 for no limit)
+     */
+    PolicyAllocator(size_t objectSize, unsigned objectsPerPage, unsigned maxPages = 0);
+
+    /**
+     * Destructor
+     * (never throws)
+     */
+    ~PolicyAllocator();
+
+    /**
+     * Allocate memory
+     * @return pointer to allocated memory
+     * @throws SimpleAllocatorException if there is no page left or no memory
+     */
+    void* allocate();
+
+    /**
+     * Free (deallocate) memory
+     * @param pObj pointer to object to deallocate
+     * @throws SimpleAllocatorException (only with DebugCheckPolicy)
+     *         if the block is not on a boundary, has already been freed
+     *         or has had its pad bytes overwritten
+     */
+    void free(void* pObj);
+
+    /**
+     * Get the statistics struct
+     * @return statistics
+     */
+    SimpleAllocatorStats getStats() const;
+
+private:
+    // Disable copy constructor and assignment operator
+    PolicyAllocator(const PolicyAllocator&) = delete;
+    PolicyAllocator& operator=(const PolicyAllocator&) = delete;
+
+    /**
+     * Round a size up to a multiple of the alignment
+     * @param size the size to round up
+     * @return the rounded size
+     */
+    static constexpr size_t alignUp(size_t size) {
+        return (size + Alignment - 1) & ~(Alignment - 1);
+    }
+
+    // bytes from the start of a page to its 1st block (the next page ptr)
+    static constexpr size_t PAGE_HEADER_SIZE = alignUp(sizeof(Node*));
+
+    // bytes from the start of a block to the object (header + pad)
+    static constexpr size_t DATA_OFFSET = alignUp(HeaderPolicy::size + PadBytes);
+
+    SimpleAllocatorStats stats_; // statistics
+    unsigned objectsPerPage_; // number of objects per page
+    unsigned maxPages_; // maximum number of pages (0 for no limit)
+    size_t blockSize_; // bytes from the start of one block to the next
+    Node* pageList_; // linked list of pages (the 1st bytes of a page link to the next)
+    Node* freeList_; // linked list of free blocks
+
+    /**
+     * Allocate a new page and thread all its blocks onto the free list
+     * @throws SimpleAllocatorException if maxPages is reached or new fails
+     */
+    void allocatePage();
+
+    /**
+     * Debug checks done before a block is freed (only with DebugCheckPolicy)
+     * @param pObj pointer to the object to be freed
+     * @throws SimpleAllocatorException if the block is not on a boundary,
+     *         has already been freed or has had its pad bytes overwritten
+     */
+    void validateFree(void* pObj) const;
+};
+
+// include the implementation as PolicyAllocator is a templated class (see BST.h)
+#include "PolicyAllocator.cpp"
+
+#endif
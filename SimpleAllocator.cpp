@@ -7,53 +7,987 @@
 // #define DEBUG
 #include "SimpleAllocator.h"
 #include <cstdio>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <new>
+#include <sstream>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// the ids of allocators are never reused (see SimpleAllocator::id_)
+static std::atomic<unsigned long long> nextAllocatorId(1);
+
+/**
+ * The caches of the calling thread, one per allocator that it has used
+ * - when the thread exits, the caches are marked so that their allocators
+ *   take back the blocks left in them
+ */
+struct SimpleAllocator::ThreadCacheList {
+    std::vector<std::shared_ptr<ThreadCache>> caches;
+
+    ~ThreadCacheList() {
+        for (const std::shared_ptr<ThreadCache>& pCache : caches)
+            pCache->isThreadAlive.store(false, std::memory_order_release);
+    }
+};
 
 SimpleAllocator::SimpleAllocator(size_t objectSize,
                                  const SimpleAllocatorConfig& config)
-    : config_(config), stats_{}{
+    : config_(config), stats_{}, pageList_(nullptr), freeList_(nullptr),
+      nextPageObjects_(config.objectsPerPage), fullyFreePages_(0), arenaPage_(nullptr),
+      arenaNext_(0), arenaSpare_(nullptr),
+      id_(nextAllocatorId.fetch_add(1)), allocateLatency_{}, freeLatency_{} {
     stats_.objectSize = objectSize;
-    config_.useCPPMemManager = true; // always true for this dummy allocator
+
+    unsigned alignment = config_.alignmentBoundary;
+    if (alignment & (alignment - 1))
+        throw SimpleAllocatorException(SimpleAllocatorException::E_BAD_CONFIG,
+                                       "SimpleAllocator: alignment is not a power of 2");
+    if (alignment == 0)
+        alignment = 1;
+
+    // the free list is threaded through the objects themselves
+    // so each object needs to be able to hold at least a Node
+    size_t storageSize = objectSize < sizeof(Node) ? sizeof(Node) : objectSize;
+
+    // block layout: | header | pad | object | pad | inter align |
+    // - the align bytes put every object on the boundary
+    dataOffset_ = config_.headerBlockInfo.size + config_.padBytesSize;
+    size_t usedSize = dataOffset_ + storageSize + config_.padBytesSize;
+    config_.interAlignBytesSize = static_cast<unsigned>((alignment - usedSize % alignment) % alignment);
+    blockSize_ = usedSize + config_.interAlignBytesSize;
+
+    // page layout: | PageInfo | left align | block | block | ... |
+    // - the page itself is allocated on the boundary
+    config_.leftAlignBytesSize =
+        static_cast<unsigned>((alignment - (sizeof(PageInfo) + dataOffset_) % alignment) % alignment);
+    firstBlockOffset_ = sizeof(PageInfo) + config_.leftAlignBytesSize;
+    pageAlignment_ = std::max<size_t>(alignment, alignof(std::max_align_t));
+    if (config_.useHugePages)
+        pageAlignment_ = std::max(pageAlignment_, HUGE_PAGE_SIZE);
+    stats_.pageSize = pageBytes(config_.objectsPerPage);
 }
 
 SimpleAllocator::~SimpleAllocator() {
+    // the threads drop their caches of this allocator when they next look
+    for (const std::shared_ptr<ThreadCache>& pCache : threadCaches_)
+        pCache->isAllocatorAlive.store(false, std::memory_order_release);
+
+    releasePages();
 }
 
 void* SimpleAllocator::allocate(const char* pLabel) {
+    if (!config_.isProfiling)
+        return allocateUnprofiled(pLabel);
+
+    auto start = std::chrono::steady_clock::now();
+    void* pObj = allocateUnprofiled(pLabel);
+    recordLatency(allocateLatency_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - start).count());
+    return pObj;
+}
+
+void SimpleAllocator::free(void* pObject) {
+    if (!config_.isProfiling) {
+        freeUnprofiled(pObject);
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    freeUnprofiled(pObject);
+    recordLatency(freeLatency_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start).count());
+}
+
+void SimpleAllocator::recordLatency(std::atomic<unsigned long long>* histogram, long long ns) {
+    // bucket i holds [2^i, 2^(i+1)) ns, so it is the index of the top bit
+    unsigned bucket = 0;
+    for (unsigned long long rest = ns > 0 ? ns >> 1 : 0; rest != 0; rest >>= 1)
+        ++bucket;
+    histogram[std::min(bucket, LATENCY_BUCKETS - 1)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void* SimpleAllocator::allocateUnprofiled(const char* pLabel) {
+    if (!config_.useThreadCache)
+        return allocateBlock(pLabel);
+
+    if (!isThreadCached()) {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        return allocateBlock(pLabel);
+    }
+
+    // pop a block from this thread's cache, refilling it first if needed
+    // - only this thread writes the counts, so no read-modify-write is needed
+    ThreadCache* pCache = getThreadCache();
+    if (pCache->pFree == nullptr)
+        refillThreadCache(*pCache);
+
+    Node* pObj = pCache->pFree;
+    pCache->pFree = pObj->pNext;
+    pCache->count.store(pCache->count.load(std::memory_order_relaxed) - 1,
+                        std::memory_order_relaxed);
+    pCache->allocations.store(pCache->allocations.load(std::memory_order_relaxed) + 1,
+                              std::memory_order_relaxed);
+    return pObj;
+}
+
+void SimpleAllocator::freeUnprofiled(void* pObject) {
+    if (!config_.useThreadCache) {
+        freeBlock(pObject);
+        return;
+    }
+
+    if (!isThreadCached()) {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        freeBlock(pObject);
+        return;
+    }
+
+    if (pObject == nullptr)
+        return;
+
+    // push the block onto this thread's cache, flushing half of it if full
+    ThreadCache* pCache = getThreadCache();
+    Node* pObj = static_cast<Node*>(pObject);
+    pObj->pNext = pCache->pFree;
+    pCache->pFree = pObj;
+    unsigned count = pCache->count.load(std::memory_order_relaxed) + 1;
+    pCache->count.store(count, std::memory_order_relaxed);
+    pCache->deallocations.store(pCache->deallocations.load(std::memory_order_relaxed) + 1,
+                                std::memory_order_relaxed);
+
+    if (count > config_.threadCacheSize)
+        flushThreadCache(*pCache, count - config_.threadCacheSize / 2);
+}
+
+void* SimpleAllocator::allocateBlock(const char* pLabel) {
     // use cpp mem manager if enabled
     if (config_.useCPPMemManager) {
-        // update stats assuming allocation succeeds
-        ++stats_.allocations;
-        ++stats_.mostObjects;
-
         // return exact number of bytes requested using char
-        return new char[stats_.objectSize];
+        char* pObj = nullptr;
+        try {
+            pObj = new char[stats_.objectSize];
+        } catch (const std::bad_alloc&) {
+            throw SimpleAllocatorException(SimpleAllocatorException::E_NO_MEMORY,
+                                           "allocate: no system memory available");
+        }
+
+        // update stats
+        ++stats_.allocations;
+        ++stats_.objectsInUse;
+        if (stats_.objectsInUse > stats_.mostObjects)
+            stats_.mostObjects = stats_.objectsInUse;
+        return pObj;
     }
+
+    Node* pObj = nullptr;
+    if (config_.isArena)
+        pObj = bumpArenaBlock();
     else {
-        // this is supposed to be the custom allocation code but this is a dummy
-        // - this should never be called in this dummy allocator
-        return nullptr;
+        // grab a new page only when there are no free blocks left
+        if (freeList_ == nullptr)
+            allocatePage();
+
+        // pop the first free block
+        pObj = popFreeBlock();
     }
+
+    // update stats
+    ++stats_.allocations;
+    ++stats_.objectsInUse;
+    --stats_.freeObjects;
+    if (stats_.objectsInUse > stats_.mostObjects)
+        stats_.mostObjects = stats_.objectsInUse;
+
+    if (config_.isDebug)
+        std::memset(pObj, ALLOCATED_PATTERN, stats_.objectSize);
+
+    if (config_.headerBlockInfo.type != SimpleAllocatorConfig::NO_HEADER)
+        writeHeader(toBlock(pObj), true, pLabel);
+
+    return pObj;
 }
 
-void SimpleAllocator::free(void* pObject) {
+void SimpleAllocator::freeBlock(void* pObject) {
+    // freeing a null pointer is a no-op, like delete
+    if (pObject == nullptr)
+        return;
+
     if (config_.useCPPMemManager) {
-        // update stats assuming allocation successful
+        delete[] static_cast<char*>(pObject);
+
+        // update stats
         ++stats_.deallocations;
-        --stats_.allocations;
+        --stats_.objectsInUse;
+        return;
+    }
 
-        // delete exact number of bytes represented using char
-        //::operator delete(static_cast<char*>(p_object), stats_.ObjectSize_);
-        delete[] static_cast<char*>(pObject);
+    if (config_.isDebug)
+        validateFree(pObject);
 
-        pObject = nullptr;
-    } 
-    else {
-        // again this should never be called in this dummy allocator
+    if (config_.headerBlockInfo.type != SimpleAllocatorConfig::NO_HEADER)
+        writeHeader(toBlock(pObject), false, nullptr);
+
+    if (config_.isDebug)
+        std::memset(pObject, FREED_PATTERN, stats_.objectSize);
+
+    // update stats
+    ++stats_.deallocations;
+    --stats_.objectsInUse;
+
+    // an arena only hands the block out again after freeAll()
+    if (config_.isArena)
+        return;
+
+    // push the block back onto the free list
+    pushFreeBlock(static_cast<Node*>(pObject));
+    ++stats_.freeObjects;
+
+    reclaimPages();
+}
+
+void SimpleAllocator::allocateBatch(unsigned n, void** pObjects, const char* pLabel) {
+    if (!isBatchable()) {
+        unsigned i = 0;
+        try {
+            for (; i < n; ++i)
+                pObjects[i] = allocate(pLabel);
+        } catch (const SimpleAllocatorException&) {
+            while (i-- > 0)
+                free(pObjects[i]);
+            throw;
+        }
+        return;
+    }
+
+    // get all the pages needed before handing out any block
+    // - pages that were added before a failure stay on as free blocks
+    while (stats_.freeObjects < n)
+        allocatePage();
+
+    for (unsigned i = 0; i < n; ++i)
+        pObjects[i] = popFreeBlock();
+
+    // update stats
+    stats_.allocations += n;
+    stats_.objectsInUse += n;
+    stats_.freeObjects -= n;
+    if (stats_.objectsInUse > stats_.mostObjects)
+        stats_.mostObjects = stats_.objectsInUse;
+}
+
+void SimpleAllocator::freeBatch(void* const* pObjects, unsigned n) {
+    if (!isBatchable()) {
+        for (unsigned i = 0; i < n; ++i)
+            free(pObjects[i]);
+        return;
+    }
+
+    // push the blocks back onto the free list, skipping null pointers like free()
+    unsigned freed = 0;
+    for (unsigned i = 0; i < n; ++i) {
+        if (pObjects[i] == nullptr)
+            continue;
+        pushFreeBlock(static_cast<Node*>(pObjects[i]));
+        ++freed;
     }
+
+    // update stats
+    stats_.deallocations += freed;
+    stats_.objectsInUse -= freed;
+    stats_.freeObjects += freed;
+
+    reclaimPages();
+}
+
+bool SimpleAllocator::freeAll() {
+    if (config_.useCPPMemManager)
+        return false;
+
+    std::unique_lock<std::mutex> lock(poolMutex_, std::defer_lock);
+    if (config_.useThreadCache)
+        lock.lock();
+
+    // the blocks in the caches are on the pages too, so empty the caches
+    // and count everything else as freed
+    unsigned inUse = stats_.objectsInUse;
+    for (const std::shared_ptr<ThreadCache>& pCache : threadCaches_) {
+        inUse -= pCache->count.load(std::memory_order_relaxed);
+        pCache->pFree = nullptr;
+        pCache->count.store(0, std::memory_order_relaxed);
+    }
+
+    // update stats
+    stats_.deallocations += inUse;
+    stats_.objectsInUse = 0;
+
+    if (config_.isArena) {
+        rewindArena();
+        return true;
+    }
+
+    releasePages();
+    stats_.freeObjects = 0;
+    stats_.pagesInUse = 0;
+    return true;
 }
 
 SimpleAllocatorConfig SimpleAllocator::getConfig() const { return config_; }
 
-SimpleAllocatorStats SimpleAllocator::getStats() const { return stats_; }
+SimpleAllocatorProfile SimpleAllocator::getProfile() const {
+    SimpleAllocatorProfile profile;
+    profile.stats = getStats();
+    for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+        profile.allocateLatency[i] = allocateLatency_[i].load(std::memory_order_relaxed);
+        profile.freeLatency[i] = freeLatency_[i].load(std::memory_order_relaxed);
+    }
+
+    std::unique_lock<std::mutex> lock(poolMutex_, std::defer_lock);
+    if (config_.useThreadCache)
+        lock.lock();
+
+    // count the free blocks on each page
+    // - an arena's free blocks are the ones it has not handed out yet
+    //   on the current page and on the pages it kept
+    std::vector<PageInfo*> pages;
+    for (PageInfo* pPage = pageList_; pPage != nullptr; pPage = pPage->pNext)
+        pages.push_back(pPage);
+    for (PageInfo* pPage = arenaSpare_; pPage != nullptr; pPage = pPage->pNext)
+        pages.push_back(pPage);
+    std::sort(pages.begin(), pages.end());
+    std::vector<unsigned> freeCounts(pages.size(), 0);
+    auto pageIndex = [&pages](PageInfo* pPage) {
+        return std::lower_bound(pages.begin(), pages.end(), pPage) - pages.begin();
+    };
+    for (Node* pFree = freeList_; pFree != nullptr; pFree = pFree->pNext)
+        ++freeCounts[pageIndex(findPage(pages, pFree))];
+    for (PageInfo* pPage = arenaSpare_; pPage != nullptr; pPage = pPage->pNext)
+        freeCounts[pageIndex(pPage)] = pPage->objects;
+    if (arenaPage_ != nullptr)
+        freeCounts[pageIndex(arenaPage_)] = arenaPage_->objects - arenaNext_;
+
+    // bucket the pages by how full they are, and count the blocks stuck as
+    // free on pages that cannot be released as they have blocks in use
+    unsigned long long usedPageBlocks = 0;
+    unsigned long long usedPageFreeBlocks = 0;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        unsigned objects = pages[i]->objects;
+        unsigned inUse = objects - freeCounts[i];
+        unsigned bucket = static_cast<unsigned>(
+            static_cast<unsigned long long>(inUse) * PAGE_FILL_BUCKETS / objects);
+        ++profile.pageFill[std::min(bucket, PAGE_FILL_BUCKETS - 1)];
+        if (inUse > 0) {
+            usedPageBlocks += objects;
+            usedPageFreeBlocks += freeCounts[i];
+        }
+    }
+    if (usedPageBlocks > 0)
+        profile.fragmentation = static_cast<double>(usedPageFreeBlocks) / usedPageBlocks;
+    return profile;
+}
+
+std::string SimpleAllocatorProfile::toJson() const {
+    std::ostringstream os;
+    auto writeArray = [&os](const char* name, const auto* values, unsigned n) {
+        os << ",\"" << name << "\":[";
+        for (unsigned i = 0; i < n; ++i)
+            os << (i > 0 ? "," : "") << values[i];
+        os << "]";
+    };
+
+    os << "{\"objectSize\":" << stats.objectSize
+       << ",\"pageSize\":" << stats.pageSize
+       << ",\"freeObjects\":" << stats.freeObjects
+       << ",\"objectsInUse\":" << stats.objectsInUse
+       << ",\"pagesInUse\":" << stats.pagesInUse
+       << ",\"mostObjects\":" << stats.mostObjects
+       << ",\"allocations\":" << stats.allocations
+       << ",\"deallocations\":" << stats.deallocations;
+    writeArray("allocateLatencyNs", allocateLatency, LATENCY_BUCKETS);
+    writeArray("freeLatencyNs", freeLatency, LATENCY_BUCKETS);
+    writeArray("pageFill", pageFill, PAGE_FILL_BUCKETS);
+    os << ",\"fragmentation\":" << fragmentation << "}";
+    return os.str();
+}
+
+SimpleAllocatorStats SimpleAllocator::getStats() const {
+    if (!config_.useThreadCache)
+        return stats_;
+
+    // the pool counts the blocks in the caches as in use, so move them
+    // over to free and add up the counts made by each thread
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    SimpleAllocatorStats stats = stats_;
+    for (const std::shared_ptr<ThreadCache>& pCache : threadCaches_) {
+        unsigned count = pCache->count.load(std::memory_order_relaxed);
+        stats.freeObjects += count;
+        stats.objectsInUse -= count;
+        stats.allocations += pCache->allocations.load(std::memory_order_relaxed);
+        stats.deallocations += pCache->deallocations.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+bool SimpleAllocator::isBatchable() const {
+    return !config_.useThreadCache && !config_.isDebug && !config_.useCPPMemManager &&
+           !config_.isArena && config_.headerBlockInfo.type == SimpleAllocatorConfig::NO_HEADER;
+}
+
+void SimpleAllocator::releasePages() {
+    // the pages an arena kept have no blocks in use
+    while (arenaSpare_ != nullptr) {
+        PageInfo* pPage = arenaSpare_;
+        arenaSpare_ = arenaSpare_->pNext;
+        freePageMemory(pPage);
+    }
+    arenaPage_ = nullptr;
+
+    // return every page to the system, including the external headers
+    // of blocks that the client never freed
+    while (pageList_ != nullptr) {
+        PageInfo* pPage = pageList_;
+        pageList_ = pageList_->pNext;
+
+        if (config_.headerBlockInfo.type == SimpleAllocatorConfig::EXTERNAL_HEADER) {
+            char* pBlock = reinterpret_cast<char*>(pPage) + firstBlockOffset_;
+            for (unsigned i = 0; i < pPage->objects; ++i, pBlock += blockSize_)
+                writeHeader(pBlock, false, nullptr);
+        }
+
+        freePageMemory(pPage);
+    }
+    freeList_ = nullptr;
+    pagesByAddress_.clear();
+    fullyFreePages_ = 0;
+}
+
+Node* SimpleAllocator::bumpArenaBlock() {
+    if (arenaPage_ == nullptr || arenaNext_ == arenaPage_->objects) {
+        if (arenaSpare_ != nullptr) {
+            // move on to a kept page
+            arenaPage_ = arenaSpare_;
+            arenaSpare_ = arenaSpare_->pNext;
+            arenaPage_->pNext = pageList_;
+            pageList_ = arenaPage_;
+            arenaNext_ = 0;
+        } else
+            allocatePage();
+    }
+
+    char* pBlock = reinterpret_cast<char*>(arenaPage_) + firstBlockOffset_ +
+                   arenaNext_++ * blockSize_;
+    return reinterpret_cast<Node*>(pBlock + dataOffset_);
+}
+
+void SimpleAllocator::rewindArena() {
+    // keep every page, freeing the external headers of the blocks on it
+    while (pageList_ != nullptr) {
+        PageInfo* pPage = pageList_;
+        pageList_ = pageList_->pNext;
+
+        if (config_.headerBlockInfo.type == SimpleAllocatorConfig::EXTERNAL_HEADER) {
+            char* pBlock = reinterpret_cast<char*>(pPage) + firstBlockOffset_;
+            for (unsigned i = 0; i < pPage->objects; ++i, pBlock += blockSize_)
+                writeHeader(pBlock, false, nullptr);
+        }
+
+        pPage->pNext = arenaSpare_;
+        arenaSpare_ = pPage;
+    }
+    arenaPage_ = nullptr;
+
+    // every block on the kept pages is free again
+    stats_.freeObjects = 0;
+    for (PageInfo* pPage = arenaSpare_; pPage != nullptr; pPage = pPage->pNext)
+        stats_.freeObjects += pPage->objects;
+}
+
+bool SimpleAllocator::isReclaiming() const {
+    return config_.reclaimThreshold > 0 && !config_.useCPPMemManager && !config_.isArena;
+}
+
+SimpleAllocator::PageInfo* SimpleAllocator::findPage(const std::vector<PageInfo*>& pages,
+                                                     const void* pObj) const {
+    // the last page that starts before the block
+    const char* pBlock = static_cast<const char*>(pObj);
+    auto it = std::upper_bound(pages.begin(), pages.end(), pBlock,
+                               [](const char* pBlock, const PageInfo* pPage) {
+                                   return pBlock < reinterpret_cast<const char*>(pPage);
+                               });
+    if (it == pages.begin())
+        return nullptr;
+
+    PageInfo* pPage = *(it - 1);
+    const char* pPageEnd =
+        reinterpret_cast<const char*>(pPage) + firstBlockOffset_ + pPage->objects * blockSize_;
+    return pBlock < pPageEnd ? pPage : nullptr;
+}
+
+Node* SimpleAllocator::popFreeBlock() {
+    Node* pObj = freeList_;
+    freeList_ = pObj->pNext;
+
+    if (isReclaiming()) {
+        PageInfo* pPage = findPage(pagesByAddress_, pObj);
+        if (pPage->freeCount-- == pPage->objects)
+            --fullyFreePages_;
+    }
+    return pObj;
+}
+
+void SimpleAllocator::pushFreeBlock(Node* pObj) {
+    pObj->pNext = freeList_;
+    freeList_ = pObj;
+
+    if (isReclaiming()) {
+        PageInfo* pPage = findPage(pagesByAddress_, pObj);
+        if (++pPage->freeCount == pPage->objects)
+            ++fullyFreePages_;
+    }
+}
+
+void SimpleAllocator::reclaimPages() {
+    // a page only goes while more than reclaimThreshold blocks stay free
+    // without it, so that allocating and freeing around the threshold does
+    // not map and release a page every time (no page is smaller than
+    // objectsPerPage)
+    if (!isReclaiming() || fullyFreePages_ == 0 ||
+        stats_.freeObjects <= config_.reclaimThreshold + config_.objectsPerPage)
+        return;
+    bool isReleasing = false;
+    for (PageInfo* pPage : pagesByAddress_)
+        isReleasing = isReleasing || (pPage->freeCount == pPage->objects &&
+                      stats_.freeObjects > config_.reclaimThreshold + pPage->objects);
+    if (!isReleasing)
+        return;
+
+    // pick the pages with no blocks in use while there are too many free blocks
+    // - they are already sorted by address, like pagesByAddress_
+    std::vector<PageInfo*> released;
+    std::vector<PageInfo*> kept;
+    for (PageInfo* pPage : pagesByAddress_) {
+        if (pPage->freeCount == pPage->objects &&
+            stats_.freeObjects > config_.reclaimThreshold + pPage->objects) {
+            released.push_back(pPage);
+            stats_.freeObjects -= pPage->objects;
+            --stats_.pagesInUse;
+            --fullyFreePages_;
+        } else
+            kept.push_back(pPage);
+    }
+    pagesByAddress_.swap(kept);
+
+    // rebuild the free list and the page list without them, keeping their order
+    Node** ppFree = &freeList_;
+    while (*ppFree != nullptr) {
+        if (findPage(released, *ppFree) != nullptr)
+            *ppFree = (*ppFree)->pNext;
+        else
+            ppFree = &(*ppFree)->pNext;
+    }
+    PageInfo** ppPage = &pageList_;
+    while (*ppPage != nullptr) {
+        if (std::binary_search(released.begin(), released.end(), *ppPage))
+            *ppPage = (*ppPage)->pNext;
+        else
+            ppPage = &(*ppPage)->pNext;
+    }
+
+    for (PageInfo* pPage : released)
+        freePageMemory(pPage);
+
+#if defined(__GLIBC__)
+    // glibc keeps big freed chunks in its heap, so hand their memory back
+    // - once for the whole batch, which the margin above keeps to at most
+    //   once per page of blocks freed
+    malloc_trim(0);
+#endif
+}
+
+bool SimpleAllocator::isThreadCached() const {
+    return config_.threadCacheSize > 0 && !config_.isDebug && !config_.useCPPMemManager &&
+           !config_.isArena && config_.headerBlockInfo.type == SimpleAllocatorConfig::NO_HEADER;
+}
+
+SimpleAllocator::ThreadCache* SimpleAllocator::getThreadCache() {
+    // one list per thread, shared by all allocators, and the last cache
+    // looked up so that a thread using one allocator skips the search
+    thread_local ThreadCacheList threadList;
+    thread_local unsigned long long lastId = 0;
+    thread_local ThreadCache* pLast = nullptr;
+    if (lastId == id_)
+        return pLast;
+
+    // look for our cache, dropping the caches of destroyed allocators
+    std::vector<std::shared_ptr<ThreadCache>>& caches = threadList.caches;
+    ThreadCache* pFound = nullptr;
+    for (size_t i = 0; i < caches.size();) {
+        if (!caches[i]->isAllocatorAlive.load(std::memory_order_acquire)) {
+            caches[i] = caches.back();
+            caches.pop_back();
+            continue;
+        }
+        if (caches[i]->allocatorId == id_)
+            pFound = caches[i].get();
+        ++i;
+    }
+
+    if (pFound == nullptr) {
+        std::shared_ptr<ThreadCache> pCache = std::make_shared<ThreadCache>();
+        pCache->pFree = nullptr;
+        pCache->count = 0;
+        pCache->allocations = 0;
+        pCache->deallocations = 0;
+        pCache->isThreadAlive = true;
+        pCache->isAllocatorAlive = true;
+        pCache->allocatorId = id_;
+        {
+            std::lock_guard<std::mutex> lock(poolMutex_);
+            threadCaches_.push_back(pCache);
+        }
+        caches.push_back(pCache);
+        pFound = pCache.get();
+    }
+
+    lastId = id_;
+    pLast = pFound;
+    return pFound;
+}
+
+void SimpleAllocator::refillThreadCache(ThreadCache& cache) {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    adoptOrphanedCaches();
+
+    // take half a cache's worth so that a thread that alternates between
+    // allocating and freeing does not bounce between refills and flushes
+    unsigned batch = config_.threadCacheSize / 2 > 0 ? config_.threadCacheSize / 2 : 1;
+    unsigned n = 0;
+    try {
+        for (; n < batch; ++n) {
+            if (freeList_ == nullptr)
+                allocatePage();
+
+            Node* pObj = popFreeBlock();
+            pObj->pNext = cache.pFree;
+            cache.pFree = pObj;
+        }
+    } catch (const SimpleAllocatorException&) {
+        // a smaller batch is fine as long as there is a block to hand out
+        if (n == 0)
+            throw;
+    }
+
+    // from the pool's point of view the blocks in a cache are in use
+    // - so mostObjects is an upper bound here, by up to a cache per thread
+    stats_.freeObjects -= n;
+    stats_.objectsInUse += n;
+    if (stats_.objectsInUse > stats_.mostObjects)
+        stats_.mostObjects = stats_.objectsInUse;
+    cache.count.store(n, std::memory_order_relaxed);
+}
+
+void SimpleAllocator::flushThreadCache(ThreadCache& cache, unsigned n) {
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    adoptOrphanedCaches();
+
+    for (unsigned i = 0; i < n; ++i) {
+        Node* pObj = cache.pFree;
+        cache.pFree = pObj->pNext;
+        pushFreeBlock(pObj);
+    }
+
+    stats_.freeObjects += n;
+    stats_.objectsInUse -= n;
+    cache.count.store(cache.count.load(std::memory_order_relaxed) - n,
+                      std::memory_order_relaxed);
+
+    reclaimPages();
+}
+
+void SimpleAllocator::adoptOrphanedCaches() {
+    for (size_t i = 0; i < threadCaches_.size();) {
+        ThreadCache& cache = *threadCaches_[i];
+        if (cache.isThreadAlive.load(std::memory_order_acquire)) {
+            ++i;
+            continue;
+        }
+
+        // the thread has exited, so its blocks and counts are ours
+        while (cache.pFree != nullptr) {
+            Node* pObj = cache.pFree;
+            cache.pFree = pObj->pNext;
+            pushFreeBlock(pObj);
+        }
+        unsigned count = cache.count.load(std::memory_order_relaxed);
+        stats_.freeObjects += count;
+        stats_.objectsInUse -= count;
+        stats_.allocations += cache.allocations.load(std::memory_order_relaxed);
+        stats_.deallocations += cache.deallocations.load(std::memory_order_relaxed);
+
+        threadCaches_[i] = threadCaches_.back();
+        threadCaches_.pop_back();
+    }
+}
+
+size_t SimpleAllocator::pageBytes(unsigned objects) const {
+    size_t pageSize = firstBlockOffset_ + objects * blockSize_;
+
+    // a huge page is only used if it is all ours
+    if (config_.useHugePages)
+        pageSize = (pageSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    return pageSize;
+}
+
+char* SimpleAllocator::allocatePageMemory(size_t pageSize) {
+    char* pPage = nullptr;
+    try {
+        pPage = static_cast<char*>(::operator new(pageSize, std::align_val_t(pageAlignment_)));
+    } catch (const std::bad_alloc&) {
+        throw SimpleAllocatorException(SimpleAllocatorException::E_NO_MEMORY,
+                                       "allocatePage: no system memory available");
+    }
+
+#if defined(__linux__)
+    // both are only hints, so a kernel without THP or NUMA support is fine
+    if (config_.useHugePages)
+        madvise(pPage, pageSize, MADV_HUGEPAGE);
+
+    if (config_.useNumaLocalPages) {
+        // prefer the node of the calling thread for the OS pages that lie
+        // wholly inside the page (the page is not touched yet, so this
+        // holds before the blocks are threaded onto the free list)
+        const int MPOL_PREFERRED_MODE = 1;
+        const unsigned MPOL_MF_MOVE_FLAG = 1 << 1;
+        unsigned cpu = 0;
+        unsigned node = 0;
+        uintptr_t osPageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t start = (reinterpret_cast<uintptr_t>(pPage) + osPageSize - 1) & ~(osPageSize - 1);
+        uintptr_t end = (reinterpret_cast<uintptr_t>(pPage) + pageSize) & ~(osPageSize - 1);
+        unsigned long nodeMask = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < 8 * sizeof(nodeMask) &&
+            start < end) {
+            nodeMask = 1UL << node;
+            syscall(SYS_mbind, start, end - start, MPOL_PREFERRED_MODE, &nodeMask,
+                    8 * sizeof(nodeMask) + 1, MPOL_MF_MOVE_FLAG);
+        }
+    }
+#endif
+    return pPage;
+}
+
+void SimpleAllocator::freePageMemory(PageInfo* pPage) {
+    ::operator delete(pPage, std::align_val_t(pageAlignment_));
+}
+
+void SimpleAllocator::allocatePage() {
+    if (config_.maxPages != 0 && stats_.pagesInUse >= config_.maxPages)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_NO_PAGE,
+                                       "allocatePage: maximum number of pages reached");
+
+    // a page rounded up to huge pages is filled with as many blocks as fit
+    size_t pageSize = pageBytes(nextPageObjects_);
+    unsigned objects = static_cast<unsigned>((pageSize - firstBlockOffset_) / blockSize_);
+    char* pPage = allocatePageMemory(pageSize);
+
+    if (config_.isDebug) {
+        std::memset(pPage, UNALLOCATED_PATTERN, pageSize);
+        std::memset(pPage + sizeof(PageInfo), ALIGN_PATTERN, config_.leftAlignBytesSize);
+    }
+
+    // link the page at the front of the page list
+    PageInfo* pPageInfo = reinterpret_cast<PageInfo*>(pPage);
+    pPageInfo->pNext = pageList_;
+    pPageInfo->objects = objects;
+    pPageInfo->freeCount = objects;
+    pageList_ = pPageInfo;
+
+    if (isReclaiming()) {
+        pagesByAddress_.insert(std::upper_bound(pagesByAddress_.begin(),
+                                                pagesByAddress_.end(), pPageInfo),
+                               pPageInfo);
+        ++fullyFreePages_;
+    }
+
+    // thread the blocks onto the free list back to front
+    // so that they are handed out in address order
+    // - an arena hands them out in order without touching them first
+    char* pFirstBlock = pPage + firstBlockOffset_;
+    bool isPreparingBlocks =
+        !config_.isArena || config_.headerBlockInfo.size > 0 || config_.isDebug;
+    for (unsigned i = isPreparingBlocks ? objects : 0; i-- > 0;) {
+        char* pBlock = pFirstBlock + i * blockSize_;
+
+        if (config_.headerBlockInfo.size > 0)
+            std::memset(pBlock, 0, config_.headerBlockInfo.size);
+
+        if (config_.isDebug) {
+            char* pInterAlign = pBlock + blockSize_ - config_.interAlignBytesSize;
+            std::memset(pBlock + config_.headerBlockInfo.size, PAD_PATTERN,
+                        config_.padBytesSize);
+            std::memset(pInterAlign - config_.padBytesSize, PAD_PATTERN,
+                        config_.padBytesSize);
+            std::memset(pInterAlign, ALIGN_PATTERN, config_.interAlignBytesSize);
+        }
+
+        if (config_.isArena)
+            continue;
+        Node* pObj = reinterpret_cast<Node*>(pBlock + dataOffset_);
+        pObj->pNext = freeList_;
+        freeList_ = pObj;
+    }
+    if (config_.isArena) {
+        arenaPage_ = pPageInfo;
+        arenaNext_ = 0;
+    }
+
+    ++stats_.pagesInUse;
+    stats_.freeObjects += objects;
+
+    // the next page is twice as big, up to the cap
+    if (config_.maxObjectsPerPage > nextPageObjects_)
+        nextPageObjects_ = std::min(2 * nextPageObjects_, config_.maxObjectsPerPage);
+}
+
+char* SimpleAllocator::toBlock(void* pObj) const {
+    return static_cast<char*>(pObj) - dataOffset_;
+}
+
+void SimpleAllocator::validateFree(void* pObj) const {
+    char* pBlock = toBlock(pObj);
+
+    // find the page the block is on and check that it is on a block boundary
+    bool isOnBoundary = false;
+    for (PageInfo* pPage = pageList_; pPage != nullptr; pPage = pPage->pNext) {
+        char* pFirstBlock = reinterpret_cast<char*>(pPage) + firstBlockOffset_;
+        char* pPageEnd = pFirstBlock + pPage->objects * blockSize_;
+        if (pBlock >= pFirstBlock && pBlock < pPageEnd) {
+            isOnBoundary = (pBlock - pFirstBlock) % blockSize_ == 0;
+
+            // an arena has only handed out the blocks before the next one
+            // on its current page (its other pages in the list are used up)
+            if (isOnBoundary && pPage == arenaPage_ &&
+                static_cast<size_t>(pBlock - pFirstBlock) / blockSize_ >= arenaNext_)
+                throw SimpleAllocatorException(
+                    SimpleAllocatorException::E_BAD_BOUNDARY,
+                    "validateFree: block has not been handed out by the arena");
+            break;
+        }
+    }
+    if (!isOnBoundary)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_BAD_BOUNDARY,
+                                       "validateFree: block is not on a block boundary");
+
+    // use the header flag if there is one, otherwise look in the free list
+    bool isFree = false;
+    switch (config_.headerBlockInfo.type) {
+    case SimpleAllocatorConfig::BASIC_HEADER:
+    case SimpleAllocatorConfig::EXTENDED_HEADER:
+        isFree = pBlock[config_.headerBlockInfo.size - 1] == 0;
+        break;
+    case SimpleAllocatorConfig::EXTERNAL_HEADER: {
+        MemBlockInfo* pInfo = nullptr;
+        std::memcpy(&pInfo, pBlock, sizeof(pInfo));
+        isFree = pInfo == nullptr;
+        break;
+    }
+    default:
+        // an arena does not put freed blocks on the free list, but in debug
+        // mode every byte of a freed object is set to FREED_PATTERN (and
+        // every byte of an allocated one starts as ALLOCATED_PATTERN)
+        if (config_.isArena) {
+            const unsigned char* pBytes = static_cast<const unsigned char*>(pObj);
+            isFree = std::all_of(pBytes, pBytes + stats_.objectSize,
+                                 [](unsigned char byte) { return byte == FREED_PATTERN; });
+            break;
+        }
+        for (Node* pFree = freeList_; pFree != nullptr; pFree = pFree->pNext) {
+            if (pFree == pObj) {
+                isFree = true;
+                break;
+            }
+        }
+        break;
+    }
+    if (isFree)
+        throw SimpleAllocatorException(SimpleAllocatorException::E_MULTIPLE_FREE,
+                                       "validateFree: block has already been freed");
+
+    // check that the pad bytes on both sides are untouched
+    const unsigned char* pLeftPad =
+        reinterpret_cast<unsigned char*>(pBlock) + config_.headerBlockInfo.size;
+    const unsigned char* pRightPad =
+        reinterpret_cast<unsigned char*>(pBlock) + blockSize_ - config_.interAlignBytesSize -
+        config_.padBytesSize;
+    for (unsigned i = 0; i < config_.padBytesSize; ++i) {
+        if (pLeftPad[i] != PAD_PATTERN || pRightPad[i] != PAD_PATTERN)
+            throw SimpleAllocatorException(SimpleAllocatorException::E_CORRUPTED_BLOCK,
+                                           "validateFree: pad bytes have been overwritten");
+    }
+}
+
+void SimpleAllocator::writeHeader(char* pBlock, bool inUse, const char* pLabel) {
+    // the allocation number of the block being allocated is the lifetime count
+    unsigned allocNum = inUse ? static_cast<unsigned>(stats_.allocations) : 0;
+    char flag = inUse ? 1 : 0;
+
+    switch (config_.headerBlockInfo.type) {
+    case SimpleAllocatorConfig::BASIC_HEADER:
+        // | alloc num | flag |
+        std::memcpy(pBlock, &allocNum, sizeof(allocNum));
+        pBlock[sizeof(allocNum)] = flag;
+        break;
+    case SimpleAllocatorConfig::EXTENDED_HEADER: {
+        // | user-defined | use count | alloc num | flag |
+        char* pUseCount = pBlock + config_.headerBlockInfo.userDefinedSize;
+        if (inUse) {
+            unsigned short useCount = 0;
+            std::memcpy(&useCount, pUseCount, sizeof(useCount));
+            ++useCount;
+            std::memcpy(pUseCount, &useCount, sizeof(useCount));
+        }
+        std::memcpy(pUseCount + sizeof(unsigned short), &allocNum, sizeof(allocNum));
+        pUseCount[sizeof(unsigned short) + sizeof(allocNum)] = flag;
+        break;
+    }
+    case SimpleAllocatorConfig::EXTERNAL_HEADER: {
+        // | MemBlockInfo* |
+        MemBlockInfo* pInfo = nullptr;
+        std::memcpy(&pInfo, pBlock, sizeof(pInfo));
+        if (pInfo != nullptr) {
+            delete[] pInfo->pLabel;
+            delete pInfo;
+            pInfo = nullptr;
+        }
+        if (inUse) {
+            try {
+                pInfo = new MemBlockInfo;
+                pInfo->inUse = true;
+                pInfo->allocNum = allocNum;
+                pInfo->pLabel = nullptr;
+                if (pLabel != nullptr) {
+                    pInfo->pLabel = new char[std::strlen(pLabel) + 1];
+                    std::strcpy(pInfo->pLabel, pLabel);
+                }
+            } catch (const std::bad_alloc&) {
+                delete pInfo;
+                throw SimpleAllocatorException(SimpleAllocatorException::E_NO_MEMORY,
+                                               "writeHeader: no system memory available");
+            }
+        }
+        std::memcpy(pBlock, &pInfo, sizeof(pInfo));
+        break;
+    }
+    default:
+        break;
+    }
+}
@@ -12,10 +12,24 @@
 #define SIMPLEALLOCATOR_H
 #include <string>
 #include <iostream>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 // Defaults for SimpleAllocator construction when client does not specify
+// - a maxPages of 0 means that there is no limit on the number of pages
 static const int DEFAULT_OBJECTS_PER_PAGE = 4;
 static const int DEFAULT_MAX_PAGES = 3;
+static const unsigned DEFAULT_THREAD_CACHE_SIZE = 64;
+
+// Size of a (transparent) huge page that useHugePages rounds pages up to
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+// Number of buckets in the latency histograms (powers of 2 in ns) and in
+// the page fill distribution (tenths of a page in use) of a profile
+static const unsigned LATENCY_BUCKETS = 32;
+static const unsigned PAGE_FILL_BUCKETS = 10;
 
 /**
  * @class SimpleAllocatorException
@@ -32,7 +46,8 @@ public:
         E_NO_PAGE, // No page available (max pages reached)
         E_BAD_BOUNDARY, // block address is on a page but not a block boundary
         E_MULTIPLE_FREE, // block has already been freed
-        E_CORRUPTED_BLOCK // block has been corrupted (pad bytes overwritten)
+        E_CORRUPTED_BLOCK, // block has been corrupted (pad bytes overwritten)
+        E_BAD_CONFIG // configuration is invalid (alignment is not a power of 2)
     };
 
     /**
@@ -128,6 +143,14 @@ struct SimpleAllocatorConfig {
      * @param alignment this refering to the boundary to align to
      * @param padBytes pad bytes
      * @param debug true if debug mode is on
+     * @param useThreadCache true to let threads share the allocator
+     * @param threadCacheSize max free blocks cached by each thread
+     * @param maxObjectsPerPage cap for the objects per page as they double
+     * @param reclaimThreshold free blocks above which free pages are released
+     * @param useHugePages back the pages with huge pages when available
+     * @param useNumaLocalPages place the pages on the calling thread's NUMA node
+     * @param isProfiling time every allocate() and free() for getProfile()
+     * @param isArena hand out blocks in order and only reuse them after freeAll()
      */
     SimpleAllocatorConfig(
             bool _useCPPMemManager = false,
@@ -136,7 +159,15 @@ struct SimpleAllocatorConfig {
             const HeaderBlockInfo& headerBlockInfo = HeaderBlockInfo(), 
             unsigned _alignmentBoundary = 0, 
             unsigned _padBytesSize = 0, 
-            bool _isDebug = false) : 
+            bool _isDebug = false,
+            bool _useThreadCache = false,
+            unsigned _threadCacheSize = DEFAULT_THREAD_CACHE_SIZE,
+            unsigned _maxObjectsPerPage = 0,
+            unsigned _reclaimThreshold = 0,
+            bool _useHugePages = false,
+            bool _useNumaLocalPages = false,
+            bool _isProfiling = false,
+            bool _isArena = false) : 
         useCPPMemManager(_useCPPMemManager), 
         objectsPerPage(_objectsPerPage), 
         maxPages(_maxPages), 
@@ -145,17 +176,36 @@ struct SimpleAllocatorConfig {
         leftAlignBytesSize(0),
         interAlignBytesSize(0),
         padBytesSize(_padBytesSize), 
-        isDebug(_isDebug){}
+        isDebug(_isDebug),
+        useThreadCache(_useThreadCache),
+        threadCacheSize(_threadCacheSize),
+        maxObjectsPerPage(_maxObjectsPerPage),
+        reclaimThreshold(_reclaimThreshold),
+        useHugePages(_useHugePages),
+        useNumaLocalPages(_useNumaLocalPages),
+        isProfiling(_isProfiling),
+        isArena(_isArena){}
 
     bool useCPPMemManager; // Use C++ memory manager (operator new) instead of malloc
     unsigned objectsPerPage; // Number of objects per page
-    unsigned maxPages; // Maximum number of pages
+    unsigned maxPages; // Maximum number of pages (0 for no limit)
     HeaderBlockInfo headerBlockInfo; // Header block information
-    unsigned alignmentBoundary; // the boundary to align to
+    unsigned alignmentBoundary; // the boundary to align each object to (0 for none, else a power of 2)
     unsigned leftAlignBytesSize; // num bytes in left alignment (computed from alignmentBoundary)
     unsigned interAlignBytesSize; // num bytes in inter alignment (computed from alignmentBoundary)
     unsigned padBytesSize; // num bytes in padding
     bool isDebug; // True if debug mode is on
+    bool useThreadCache; // True to make allocate()/free() thread-safe with per-thread caches
+    unsigned threadCacheSize; // Max free blocks cached per thread (0 to lock on every call)
+    unsigned maxObjectsPerPage; // Each new page doubles objectsPerPage up to this (0 for fixed-size pages)
+    unsigned reclaimThreshold; // Release pages with no objects in use while more than this many
+                               // objects stay free without them (0 to never release pages
+                               // before destruction)
+    bool useHugePages; // Round pages up to whole huge pages and ask the OS to back them with huge pages
+    bool useNumaLocalPages; // Bind each page to the NUMA node of the thread that allocates it
+    bool isProfiling; // True to record the latency of every allocate() and free()
+    bool isArena; // True to bump through the pages instead of using a free list:
+                  // free() only updates the stats and freeAll() keeps the pages
 };
 
 /**
@@ -186,13 +236,40 @@ struct SimpleAllocatorStats {
         deallocations(0) {}
 
     size_t objectSize;      // fixed size of each object
-    size_t pageSize;        // fixed size of each page
+    size_t pageSize;        // fixed size of each page (of the 1st page if pages grow)
     unsigned freeObjects;   // current number of free objects
     unsigned objectsInUse; // current number of objects in use
     unsigned pagesInUse; // current number of pages in use
     unsigned mostObjects; // most objects in use over lifetime
-    unsigned allocations; // total number of allocations over lifetime
-    unsigned deallocations; // total number of deallocations over lifetime
+    unsigned long long allocations; // total number of allocations over lifetime
+    unsigned long long deallocations; // total number of deallocations over lifetime
+};
+
+/**
+ * SimpleAllocator profile struct
+ * - the stats plus the distributions that are needed to size a pool
+ */
+struct SimpleAllocatorProfile {
+    /**
+     * Constructor
+     * - all counts are initialized to 0
+     */
+    SimpleAllocatorProfile() : stats(), allocateLatency{}, freeLatency{}, pageFill{},
+                               fragmentation(0) {}
+
+    /**
+     * Write the profile as a JSON object
+     * @return the JSON text (on one line)
+     */
+    std::string toJson() const;
+
+    SimpleAllocatorStats stats; // the stats at the time of the profile
+    unsigned long long allocateLatency[LATENCY_BUCKETS]; // allocate() calls that took
+                                                         // [2^i, 2^(i+1)) ns ([0, 2) for i = 0)
+    unsigned long long freeLatency[LATENCY_BUCKETS]; // free() calls, bucketed the same way
+    unsigned pageFill[PAGE_FILL_BUCKETS]; // pages with [i/10, (i+1)/10) of their blocks in use
+                                          // (full pages are counted in the last bucket)
+    double fragmentation; // share of the blocks on pages in use that are free (0 to 1)
 };
 
 /**
@@ -238,6 +315,9 @@ public:
 
     /**
      * Allocate memory
+     * - thread-safe with useThreadCache, where a block is taken from the
+     *   calling thread's cache, which is refilled in a batch from the shared
+     *   pages when it runs out
      * @param label label for memory block (only for EXTERNAL_HEADER)
      * @return pointer to allocated memory
      */
@@ -245,10 +325,42 @@ public:
 
     /**
      * Free (deallocate) memory
+     * - thread-safe with useThreadCache, where a block goes into the calling
+     *   thread's cache, which flushes a batch back to the shared free list
+     *   when it is full
      * @param obj pointer to object to deallocate
      */
     void free(void* pObj);
 
+    /**
+     * Allocate a batch of blocks with the bookkeeping done once
+     * - all or nothing: on failure, no block is left allocated
+     * @param n number of blocks to allocate
+     * @param pObjects array to receive the n pointers
+     * @param label label for the memory blocks (only for EXTERNAL_HEADER)
+     * @throws SimpleAllocatorException if there is not enough memory
+     */
+    void allocateBatch(unsigned n, void** pObjects, const char* pLabel = 0);
+
+    /**
+     * Free a batch of blocks with the bookkeeping done once
+     * @param pObjects array of pointers to the objects to deallocate
+     * @param n number of pointers in the array
+     */
+    void freeBatch(void* const* pObjects, unsigned n);
+
+    /**
+     * Free every allocated block at once by releasing all the pages
+     * - with isArena the pages are kept instead, to be handed out again
+     *   from the start
+     * - the client must not use any block allocated before the call
+     *   (and with useThreadCache, no other thread may be using the allocator)
+     * - the objects in the blocks are not destroyed
+     * @return false if nothing was done as the blocks are not pooled
+     *         (useCPPMemManager), so they must be freed one by one
+     */
+    bool freeAll();
+
     /**
      * Get the configuration parameters struct
      * @return configuration parameters
@@ -257,10 +369,21 @@ public:
 
     /**
      * Get the statistics struct
+     * - with useThreadCache the counts of all the threads are added up,
+     *   so they are exact once the threads using the allocator are idle
      * @return statistics
      */
     SimpleAllocatorStats getStats() const;
 
+    /**
+     * Get the stats with the latency histograms (only with isProfiling),
+     * the page fill distribution and the fragmentation
+     * - the pages are walked, so this is O(free blocks * log(pages))
+     * - with useThreadCache the blocks in the threads' caches count as in use
+     * @return profile
+     */
+    SimpleAllocatorProfile getProfile() const;
+
 private:
     // Disable copy constructor and assignment operator
     SimpleAllocator(const SimpleAllocator&) = delete;
@@ -270,6 +393,241 @@ private:
     // - feel free to add your own private stuff
     SimpleAllocatorConfig config_; // Configuration parameters
     SimpleAllocatorStats stats_; // Configuration parameters
+
+    /**
+     * The start of each page, with page layout: | PageInfo | block | block | ... |
+     */
+    struct PageInfo {
+        PageInfo* pNext; // next page in the page list
+        unsigned objects; // number of blocks on the page
+        unsigned freeCount; // number of free blocks on the page (only kept up when reclaiming)
+    };
+
+    PageInfo* pageList_; // linked list of pages
+    Node* freeList_; // linked list of free blocks (the 1st bytes of a free object link to the next)
+    unsigned nextPageObjects_; // number of blocks on the next page (doubles up to maxObjectsPerPage)
+    std::vector<PageInfo*> pagesByAddress_; // pages sorted by address (only kept when reclaiming)
+    unsigned fullyFreePages_; // number of pages with no blocks in use (only kept when reclaiming)
+    PageInfo* arenaPage_; // the page an arena is handing out blocks from (nullptr if none)
+    unsigned arenaNext_; // the index of the next block an arena hands out on arenaPage_
+    PageInfo* arenaSpare_; // pages an arena has kept after freeAll() and not handed out from yet
+    size_t blockSize_; // bytes from the start of one block to the next (header + pads + object)
+    size_t dataOffset_; // bytes from the start of a block to the object (header + pad)
+    size_t firstBlockOffset_; // bytes from the start of a page to its 1st block (PageInfo + left align)
+    size_t pageAlignment_; // the boundary each page is allocated on
+
+    /**
+     * A thread's cache (magazine) of free blocks of one allocator
+     * - only its thread touches the blocks, so allocating and freeing
+     *   through it needs no lock
+     * - the counts are atomic only so that getStats() can read them
+     * - it is shared by the allocator and the thread, so it outlives
+     *   whichever of the two goes first
+     */
+    struct ThreadCache {
+        Node* pFree; // linked list of the cached free blocks
+        std::atomic<unsigned> count; // number of cached free blocks
+        std::atomic<unsigned long long> allocations; // allocations made by the thread
+        std::atomic<unsigned long long> deallocations; // deallocations made by the thread
+        std::atomic<bool> isThreadAlive; // false once the thread has exited
+        std::atomic<bool> isAllocatorAlive; // false once the allocator is destroyed
+        unsigned long long allocatorId; // the id_ of the allocator it caches for
+    };
+
+    // the caches of the calling thread (defined in the .cpp)
+    struct ThreadCacheList;
+
+    unsigned long long id_; // unique id, so a thread never mixes up the caches of
+                            // a destroyed allocator and a new one at the same address
+    mutable std::mutex poolMutex_; // guards the pages, free list, stats and caches list
+    std::vector<std::shared_ptr<ThreadCache>> threadCaches_; // caches of all threads
+    std::atomic<unsigned long long> allocateLatency_[LATENCY_BUCKETS]; // see SimpleAllocatorProfile
+    std::atomic<unsigned long long> freeLatency_[LATENCY_BUCKETS]; // see SimpleAllocatorProfile
+
+    /**
+     * Allocate a block through the thread cache, the lock or neither
+     * @param label label for memory block (only for EXTERNAL_HEADER)
+     * @return pointer to allocated memory
+     */
+    void* allocateUnprofiled(const char* pLabel);
+
+    /**
+     * Free a block through the thread cache, the lock or neither
+     * @param pObj pointer to object to deallocate
+     */
+    void freeUnprofiled(void* pObj);
+
+    /**
+     * Count a call in a latency histogram
+     * @param histogram the histogram
+     * @param ns the time the call took in nanoseconds
+     */
+    static void recordLatency(std::atomic<unsigned long long>* histogram, long long ns);
+
+    /**
+     * Allocate a block without a thread cache or a lock
+     * @param label label for memory block (only for EXTERNAL_HEADER)
+     * @return pointer to allocated memory
+     */
+    void* allocateBlock(const char* pLabel);
+
+    /**
+     * Free a block without a thread cache or a lock
+     * @param pObj pointer to object to deallocate
+     */
+    void freeBlock(void* pObj);
+
+    /**
+     * Check if allocate() and free() go through the thread caches
+     * - the debug checks and the headers need every block to be tracked
+     *   by the allocator, so those configs take the lock on every call instead
+     * @return true if the thread caches are used
+     */
+    bool isThreadCached() const;
+
+    /**
+     * Get the calling thread's cache for this allocator, making it if needed
+     * @return the cache
+     */
+    ThreadCache* getThreadCache();
+
+    /**
+     * Move a batch of free blocks from the shared free list into an empty cache
+     * @param cache the cache to be refilled
+     * @throws SimpleAllocatorException if not even one block is available
+     */
+    void refillThreadCache(ThreadCache& cache);
+
+    /**
+     * Move a batch of free blocks from a cache back to the shared free list
+     * @param cache the cache to be flushed
+     * @param n the number of blocks to be moved
+     */
+    void flushThreadCache(ThreadCache& cache, unsigned n);
+
+    /**
+     * Take back the blocks and counts of the caches of exited threads
+     * (the pool lock must be held)
+     */
+    void adoptOrphanedCaches();
+
+    /**
+     * Check if the batch calls can pop and push the free list directly
+     * - otherwise they call allocate() and free() for each block
+     * @return true if the blocks need no per-block work
+     */
+    bool isBatchable() const;
+
+    /**
+     * Return every page to the system (the free list is emptied too)
+     */
+    void releasePages();
+
+    /**
+     * Hand out the next block of an arena, moving on to a kept page or a new
+     * page when the current one is used up
+     * @return the block
+     * @throws SimpleAllocatorException if maxPages is reached or new fails
+     */
+    Node* bumpArenaBlock();
+
+    /**
+     * Make every page of an arena a kept page, to be handed out again
+     * from the start (the blocks on them are no longer in use)
+     */
+    void rewindArena();
+
+    /**
+     * Check if pages with no blocks in use are released
+     * @return true if reclaimThreshold is set (and the blocks are pooled)
+     */
+    bool isReclaiming() const;
+
+    /**
+     * Find the page that a block is on
+     * @param pages pages sorted by address
+     * @param pObj pointer to the object
+     * @return the page (nullptr if the block is not on any of the pages)
+     */
+    PageInfo* findPage(const std::vector<PageInfo*>& pages, const void* pObj) const;
+
+    /**
+     * Pop the first block off the free list (which must not be empty)
+     * @return the block
+     */
+    Node* popFreeBlock();
+
+    /**
+     * Push a block onto the free list
+     * @param pObj the block
+     */
+    void pushFreeBlock(Node* pObj);
+
+    /**
+     * Release the pages with no blocks in use while more than
+     * reclaimThreshold blocks would still be free without them
+     * - the free list is rebuilt without their blocks, so this is
+     *   O(free blocks) and only done when there is such a page
+     * - the margin of a page means it runs at most once per page of
+     *   blocks freed, however the threshold compares to the page size
+     */
+    void reclaimPages();
+
+    /**
+     * Get the size of a page
+     * @param objects number of blocks on the page
+     * @return the size in bytes
+     */
+    size_t pageBytes(unsigned objects) const;
+
+    /**
+     * Get memory for a page from the system, aligned to pageAlignment_
+     * - with useHugePages or useNumaLocalPages, the OS is asked to back it
+     *   with huge pages or to place it on the calling thread's NUMA node,
+     *   which it may ignore
+     * @param pageSize the size of the page
+     * @return the memory
+     * @throws SimpleAllocatorException if new fails
+     */
+    char* allocatePageMemory(size_t pageSize);
+
+    /**
+     * Return the memory of a page to the system
+     * @param pPage the page
+     */
+    void freePageMemory(PageInfo* pPage);
+
+    /**
+     * Allocate a new page and thread all its blocks onto the free list
+     * @throws SimpleAllocatorException if maxPages is reached or new fails
+     */
+    void allocatePage();
+
+    /**
+     * Get the block (header) address of an object
+     * @param pObj pointer to the object
+     * @return pointer to the start of the block holding the object
+     */
+    char* toBlock(void* pObj) const;
+
+    /**
+     * Debug checks done before a block is freed
+     * - an arena without headers takes an object whose bytes are all
+     *   FREED_PATTERN as freed, so a client that fills a whole object with
+     *   that pattern gets a false double free
+     * @param pObj pointer to the object to be freed
+     * @throws SimpleAllocatorException if the block is not on a boundary,
+     *         has already been freed or has had its pad bytes overwritten
+     */
+    void validateFree(void* pObj) const;
+
+    /**
+     * Write the header of a block that is being allocated or freed
+     * @param pBlock pointer to the start of the block
+     * @param inUse true if the block is being allocated
+     * @param pLabel label for the block (only for EXTERNAL_HEADER)
+     */
+    void writeHeader(char* pBlock, bool inUse, const char* pLabel);
 };
 
 #endif // SIMPLEALLOCATOR_H
@@ -0,0 +1,1636 @@
+/** @file bench.cpp
+ * @brief Benchmarks for the BST and SimpleAllocator.
+ *        Like the test driver, the benchmark to run is selected by number,
+ *        e.g., `make bench1` or `./bench-app 1`.
+ *        Timings are machine dependent so there are no expected outputs.
+ * @author Chek
+ * @date 12 Sep 2023
+ */
+
+#include "BST.h"
+#include "AVL.h"
+#include "FrozenBST.h"
+#include "CompactBST.h"
+#include "ConcurrentBST.h"
+#include "MultiWriterBST.h"
+#include "PersistentBST.h"
+#include "SimpleAllocator.h"
+#include "PolicyAllocator.h"
+#include "prng.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using std::cout;
+using std::endl;
+
+// count the heap allocations made through operator new (and so new[] too)
+// - replacing the global operator new is only done in this benchmark driver
+static unsigned long long HeapAllocations = 0;
+
+void* operator new(std::size_t size) {
+    ++HeapAllocations;
+    if (void* p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+// - GCC takes free() on a block from operator new as a mismatch once these
+//   are inlined, but it is malloc()'s block here
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+/**
+ * @brief A simple wall clock stopwatch
+ */
+class Stopwatch {
+  public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    /**
+     * @brief Get the elapsed time since construction
+     * @return elapsed time in milliseconds
+     */
+    double elapsedMs() const {
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start_;
+        return elapsed.count();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Print one row of benchmark results
+ * @param label what was measured
+ * @param n number of operations
+ * @param ms time taken in milliseconds
+ */
+void printRow(const std::string& label, int n, double ms) {
+    cout << "  " << std::left << std::setw(28) << label << std::right
+         << " n=" << std::setw(9) << n << std::fixed << std::setprecision(2)
+         << std::setw(12) << ms << " ms" << std::setw(12)
+         << (ms * 1e6 / n) << " ns/op" << endl;
+}
+
+/**
+ * @brief Time sorted inserts into a tree
+ * @tparam Tree type of tree to insert into
+ * @param n number of sorted keys to insert
+ * @return time taken in milliseconds
+ */
+template <typename Tree> double timeSortedAdds(int n) {
+    Tree tree;
+    Stopwatch sw;
+    for (int i = 0; i < n; ++i)
+        tree.add(i);
+    return sw.elapsedMs();
+}
+
+/**
+ * @brief Sorted inserts into a BST vs an AVL
+ *        - the BST degrades into a linked list, so doubling n quadruples
+ *          the time, while the AVL only grows by a bit more than double
+ *        - the BST sizes are kept small as it is quadratic (and recursive)
+ */
+void benchSortedAdds() {
+    cout << "Sorted adds into a BST (expect ~4x per doubling):" << endl;
+    for (int n = 5000; n <= 20000; n *= 2)
+        printRow("BST<int>::add (sorted)", n, timeSortedAdds<BST<int>>(n));
+
+    cout << "Sorted adds into an AVL (expect ~2x per doubling):" << endl;
+    for (int n = 250000; n <= 1000000; n *= 2)
+        printRow("AVL<int>::add (sorted)", n, timeSortedAdds<AVL<int>>(n));
+}
+
+/**
+ * @brief Time alloc/free cycles of BST nodes through an allocator
+ *        - all n nodes are allocated, then all freed, for a few rounds
+ *          so that the pooled path reuses its pages after the 1st round
+ * @tparam Allocator SimpleAllocator or a PolicyAllocator
+ * @param allocator the allocator to allocate from
+ * @param n number of nodes per round
+ * @param rounds number of rounds
+ * @return time taken in milliseconds
+ */
+template <typename Allocator>
+double timeAllocFreeWith(Allocator& allocator, int n, int rounds) {
+    std::vector<void*> nodes(n);
+    Stopwatch sw;
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < n; ++i)
+            nodes[i] = allocator.allocate();
+        for (int i = 0; i < n; ++i)
+            allocator.free(nodes[i]);
+    }
+    return sw.elapsedMs();
+}
+
+/**
+ * @brief Time alloc/free cycles of BST nodes through a SimpleAllocator
+ * @param config the allocator configuration
+ * @param n number of nodes per round
+ * @param rounds number of rounds
+ * @return time taken in milliseconds
+ */
+double timeAllocFree(const SimpleAllocatorConfig& config, int n, int rounds) {
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+    return timeAllocFreeWith(allocator, n, rounds);
+}
+
+/**
+ * @brief Time random adds, finds and clear of a BST using an allocator
+ * @param config the allocator configuration
+ * @param n number of keys
+ * @return time taken in milliseconds
+ */
+double timeTreeChurn(const SimpleAllocatorConfig& config, int n) {
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::rand() % (i + 1)]);
+
+    Stopwatch sw;
+    BST<int> bst(&allocator);
+    for (int i = 0; i < n; ++i)
+        bst.add(keys[i]);
+    unsigned compares = 0;
+    for (int i = 0; i < n; ++i)
+        bst.find(keys[i], compares);
+    bst.clear();
+    return sw.elapsedMs();
+}
+
+/**
+ * @brief Pooled SimpleAllocator pages vs forwarding to new[]/delete[]
+ */
+void benchAllocator() {
+    const int n = 1000000;
+    SimpleAllocatorConfig cppConfig(true);
+    SimpleAllocatorConfig poolConfig(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+
+    cout << "Alloc/free cycles of BST<int> nodes (5 rounds):" << endl;
+    printRow("useCPPMemManager", 5 * n, timeAllocFree(cppConfig, n, 5));
+    printRow("pooled pages", 5 * n, timeAllocFree(poolConfig, n, 5));
+
+    cout << "Random adds + finds + clear of a BST<int>:" << endl;
+    printRow("useCPPMemManager", n, timeTreeChurn(cppConfig, n));
+    printRow("pooled pages", n, timeTreeChurn(poolConfig, n));
+}
+
+/**
+ * @brief Bulk build from sorted keys vs repeated adds
+ *        - the BST adds use shuffled keys as sorted ones are quadratic
+ */
+void benchBuild() {
+    const int n = 1000000;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+
+    cout << "Building a tree of sorted keys:" << endl;
+    {
+        Stopwatch sw;
+        BST<int> bst(keys.begin(), keys.end());
+        printRow("BST<int>(first, last)", n, sw.elapsedMs());
+    }
+    {
+        Stopwatch sw;
+        AVL<int> avl;
+        for (int i = 0; i < n; ++i)
+            avl.add(keys[i]);
+        printRow("AVL<int>::add (sorted)", n, sw.elapsedMs());
+    }
+
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::rand() % (i + 1)]);
+    {
+        Stopwatch sw;
+        BST<int> bst;
+        for (int i = 0; i < n; ++i)
+            bst.add(keys[i]);
+        printRow("BST<int>::add (shuffled)", n, sw.elapsedMs());
+    }
+}
+
+/**
+ * @brief Time the core operations of a BST<int> on a sequence of keys
+ * @param keys the keys to add, in the order to add them
+ */
+void timeCoreOps(const std::vector<int>& keys) {
+    int n = static_cast<int>(keys.size());
+    BST<int> bst;
+
+    Stopwatch addSw;
+    for (int i = 0; i < n; ++i)
+        bst.add(keys[i]);
+    printRow("add", n, addSw.elapsedMs());
+
+    // sum up the results so that the lookups are not optimized away
+    long long sink = 0;
+
+    Stopwatch findSw;
+    unsigned compares = 0;
+    for (int i = 0; i < n; ++i)
+        sink += bst.find(keys[i], compares);
+    printRow("find", n, findSw.elapsedMs());
+
+    Stopwatch subscriptSw;
+    for (int i = 0; i < n; ++i)
+        sink += bst[i]->data;
+    printRow("operator[]", n, subscriptSw.elapsedMs());
+
+    Stopwatch heightSw;
+    int height = bst.height();
+    printRow("height (" + std::to_string(height) + ")", n, heightSw.elapsedMs());
+
+    {
+        Stopwatch copySw;
+        BST<int> copy(bst);
+        printRow("copy ctor", n, copySw.elapsedMs());
+    }
+
+    Stopwatch removeSw;
+    for (int i = 0; i < n; i += 2)
+        bst.remove(keys[i]);
+    printRow("remove (every other key)", n / 2, removeSw.elapsedMs());
+
+    Stopwatch clearSw;
+    bst.clear();
+    printRow("clear", n - n / 2, clearSw.elapsedMs());
+
+    if (sink == 0)
+        cout << "  (nothing found)" << endl;
+}
+
+/**
+ * @brief Core BST operations on shuffled keys and on a degenerate tree
+ *        - sorted keys make a linked list, so n is kept small enough for
+ *          the quadratic adds to finish, but deep enough to stress recursion
+ */
+void benchCoreOps() {
+    const int n = 1000000;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::rand() % (i + 1)]);
+
+    cout << "Shuffled keys:" << endl;
+    timeCoreOps(keys);
+
+    const int deep = 20000;
+    std::vector<int> sorted(deep);
+    for (int i = 0; i < deep; ++i)
+        sorted[i] = i;
+
+    cout << "Sorted keys (degenerate tree):" << endl;
+    timeCoreOps(sorted);
+}
+
+/**
+ * @brief Full in-order traversal with iterators vs operator[]
+ */
+void benchTraversal() {
+    const int n = 10000000;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+    BST<int> bst(keys.begin(), keys.end());
+
+    // sum up the values so that the traversals are not optimized away
+    long long sum = 0;
+
+    Stopwatch iteratorSw;
+    for (int value : bst)
+        sum += value;
+    printRow("range-for", n, iteratorSw.elapsedMs());
+
+    Stopwatch reverseSw;
+    for (BST<int>::const_reverse_iterator it = bst.rbegin(); it != bst.rend(); ++it)
+        sum += *it;
+    printRow("rbegin() to rend()", n, reverseSw.elapsedMs());
+
+    Stopwatch subscriptSw;
+    for (int i = 0; i < n; ++i)
+        sum += bst[i]->data;
+    printRow("operator[] for each index", n, subscriptSw.elapsedMs());
+
+    cout << "  (sum " << sum << ")" << endl;
+}
+
+/**
+ * @brief Range count queries with the cached counts vs walking the range
+ */
+void benchRangeCount() {
+    const int n = 1000000;
+    const int queries = 1000000;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i;
+    AVL<int> avl(keys.begin(), keys.end());
+
+    // random ranges over the keys and the gaps between them
+    std::vector<std::pair<int, int>> ranges(queries);
+    Utils::srand(8, 1);
+    for (int i = 0; i < queries; ++i) {
+        int lo = Utils::rand() % (2 * n);
+        ranges[i] = std::make_pair(lo, lo + Utils::rand() % (2 * n - lo));
+    }
+
+    long long total = 0;
+    Stopwatch countSw;
+    for (int i = 0; i < queries; ++i)
+        total += avl.countInRange(ranges[i].first, ranges[i].second);
+    printRow("countInRange", queries, countSw.elapsedMs());
+
+    // walking each range is O(k) so only a few of these are timed
+    const int walks = 100;
+    Stopwatch walkSw;
+    for (int i = 0; i < walks; ++i) {
+        AVL<int>::const_iterator last = avl.upperBound(ranges[i].second);
+        for (AVL<int>::const_iterator it = avl.lowerBound(ranges[i].first);
+             it != last; ++it)
+            ++total;
+    }
+    printRow("lowerBound to upperBound", walks, walkSw.elapsedMs());
+
+    cout << "  (total " << total << ")" << endl;
+}
+
+/**
+ * @brief Print one row of results with the heap allocations per op
+ * @param label what was measured
+ * @param n number of operations
+ * @param ms time taken in milliseconds
+ * @param allocations number of heap allocations made
+ */
+void printAllocRow(const std::string& label, int n, double ms,
+                   unsigned long long allocations) {
+    printRow(label, n, ms);
+    cout << "  " << std::setw(28) << "" << std::fixed << std::setprecision(2)
+         << static_cast<double>(allocations) / n << " heap allocations/op" << endl;
+}
+
+/**
+ * @brief Adding long std::string keys by copy, from a temporary,
+ *        in place and by move
+ */
+void benchStringAdds() {
+    const int n = 1000000;
+
+    // keys that are too long for the small string optimization
+    std::vector<std::string> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = "some-long-prefix-to-defeat-sso/" + std::to_string(i);
+    std::vector<const char*> cstrs(n);
+    for (int i = 0; i < n; ++i)
+        cstrs[i] = keys[i].c_str();
+
+    {
+        BST<std::string> bst;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            bst.add(static_cast<const std::string&>(std::string(cstrs[i])));
+        printAllocRow("add(const T&) of temporary", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    {
+        BST<std::string> bst;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            bst.add(std::string(cstrs[i]));
+        printAllocRow("add(T&&) of temporary", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    {
+        BST<std::string> bst;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            bst.emplace(cstrs[i]);
+        printAllocRow("emplace(const char*)", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    {
+        BST<std::string> bst;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            bst.add(std::move(keys[i]));
+        printAllocRow("add(T&&) of existing key", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+}
+
+/**
+ * @brief Looking up long std::string keys by const char*, with the default
+ *        std::less<std::string> (a std::string is made per lookup) and with
+ *        the transparent std::less<> (the const char* is compared directly)
+ */
+void benchTransparentFind() {
+    const int n = 1000000;
+
+    std::vector<std::string> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = "some-long-prefix-to-defeat-sso/" + std::to_string(i);
+    AVL<std::string> avl;
+    AVL<std::string, std::less<>> transparentAvl;
+    for (int i = 0; i < n; ++i) {
+        avl.add(keys[i]);
+        transparentAvl.add(keys[i]);
+    }
+
+    // look them up in a shuffled order
+    std::vector<const char*> cstrs(n);
+    Utils::srand(8, 1);
+    for (int i = 0; i < n; ++i)
+        cstrs[i] = keys[i].c_str();
+    for (int i = n - 1; i > 0; --i)
+        std::swap(cstrs[i], cstrs[Utils::rand() % (i + 1)]);
+
+    unsigned compares = 0;
+    unsigned found = 0;
+    {
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            found += avl.find(cstrs[i], compares);
+        printAllocRow("less<T>: find(const char*)", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    {
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            found += transparentAvl.find(cstrs[i], compares);
+        printAllocRow("less<>: find(const char*)", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    {
+        // a string_view knows its length, so each compare need not strlen
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        for (int i = 0; i < n; ++i)
+            found += transparentAvl.find(std::string_view(cstrs[i]), compares);
+        printAllocRow("less<>: find(string_view)", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+    }
+    cout << "  (found " << found << ")" << endl;
+}
+
+/**
+ * @brief Random lookups in a 10M key AVL against its Eytzinger snapshot
+ */
+void benchFrozenFind() {
+    const int n = 10000000;
+    const int lookups = 2000000;
+
+    // even keys, so that odd lookups miss
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i;
+    AVL<int> avl(keys.begin(), keys.end());
+
+    Stopwatch freezeSw;
+    FrozenBST<int> frozen = freeze(avl);
+    printRow("freeze", n, freezeSw.elapsedMs());
+
+    std::vector<int> queries(lookups);
+    Utils::srand(8, 1);
+    for (int i = 0; i < lookups; ++i)
+        queries[i] = static_cast<int>(Utils::rand() % (2 * n));
+
+    unsigned compares = 0;
+    unsigned found = 0;
+    {
+        Stopwatch sw;
+        for (int i = 0; i < lookups; ++i)
+            found += avl.find(queries[i], compares);
+        printRow("AVL<int>::find", lookups, sw.elapsedMs());
+    }
+    {
+        Stopwatch sw;
+        for (int i = 0; i < lookups; ++i)
+            found += frozen.find(queries[i], compares);
+        printRow("FrozenBST<int>::find", lookups, sw.elapsedMs());
+    }
+    cout << "  (found " << found << ")" << endl;
+}
+
+/**
+ * @brief Time threads that each allocate a batch of blocks and free them again
+ * @param label what was measured
+ * @param threads number of threads
+ * @param allocate allocates a block
+ * @param free frees a block
+ */
+template <typename Allocate, typename Free>
+void benchThreadedAllocs(const std::string& label, int threads, Allocate allocate,
+                         Free free) {
+    const int rounds = 1000;
+    const int batch = 1000;
+
+    Stopwatch sw;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&]() {
+            std::vector<void*> blocks(batch);
+            for (int r = 0; r < rounds; ++r) {
+                for (int i = 0; i < batch; ++i)
+                    blocks[i] = allocate();
+                for (int i = batch; i-- > 0;)
+                    free(blocks[i]);
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    // every thread does the same work, so perfect scaling keeps the time flat
+    printRow(label + " x" + std::to_string(threads), threads * rounds * batch,
+             sw.elapsedMs());
+}
+
+/**
+ * @brief Allocating and freeing nodes from several threads at once through
+ *        a shared allocator that takes a lock on every call, one with
+ *        per-thread caches, and malloc/free
+ */
+void benchThreadCache() {
+    const size_t objectSize = sizeof(BST<int>::BinTreeNode);
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+
+    for (int threads = 1; threads <= 16; threads *= 2) {
+        SimpleAllocatorConfig lockedConfig(false, BST_OBJECTS_PER_PAGE, 0,
+                                           SimpleAllocatorConfig::HeaderBlockInfo(),
+                                           0, 0, false, true, 0);
+        SimpleAllocator locked(objectSize, lockedConfig);
+        benchThreadedAllocs("locked", threads,
+                            [&]() { return locked.allocate(); },
+                            [&](void* p) { locked.free(p); });
+
+        SimpleAllocatorConfig cachedConfig(false, BST_OBJECTS_PER_PAGE, 0,
+                                           SimpleAllocatorConfig::HeaderBlockInfo(),
+                                           0, 0, false, true);
+        SimpleAllocator cached(objectSize, cachedConfig);
+        benchThreadedAllocs("thread cache", threads,
+                            [&]() { return cached.allocate(); },
+                            [&](void* p) { cached.free(p); });
+
+        benchThreadedAllocs("malloc", threads,
+                            [&]() { return std::malloc(objectSize); },
+                            [&](void* p) { std::free(p); });
+    }
+}
+
+/**
+ * @brief Copying and clearing 10M-node trees, with the tree owning its
+ *        allocator (clear releases the pages) and with a shared one
+ *        (clear frees the nodes in batches)
+ */
+void benchCopyClear() {
+    const int n = 10000000;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+
+    {
+        AVL<int> avl(keys.begin(), keys.end());
+        Stopwatch copySw;
+        AVL<int> copy(avl);
+        printRow("copy ctor (own allocator)", n, copySw.elapsedMs());
+        Stopwatch clearSw;
+        copy.clear();
+        printRow("clear (own allocator)", n, clearSw.elapsedMs());
+    }
+    {
+        SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, 0);
+        SimpleAllocator allocator(sizeof(AVL<int>::BinTreeNode), config);
+        AVL<int> avl(keys.begin(), keys.end(), &allocator);
+        Stopwatch copySw;
+        AVL<int> copy(avl);
+        printRow("copy ctor (shared allocator)", n, copySw.elapsedMs());
+        Stopwatch clearSw;
+        copy.clear();
+        printRow("clear (shared allocator)", n, clearSw.elapsedMs());
+    }
+}
+
+/**
+ * @brief Get the resident set size of the process
+ * @return the RSS in MB (-1 if /proc is not available)
+ */
+double residentMB() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long resident = 0;
+    if (!(statm >> pages >> resident))
+        return -1;
+    return resident * 4096.0 / (1024 * 1024);
+}
+
+/**
+ * @brief Print the pages and memory held after a churn phase
+ * @param label what was done
+ * @param allocator allocator to report on
+ */
+void printChurnRow(const std::string& label, const SimpleAllocator& allocator) {
+    SimpleAllocatorStats stats = allocator.getStats();
+    cout << "  " << std::left << std::setw(28) << label << std::right
+         << " pages=" << std::setw(6) << stats.pagesInUse
+         << " in use=" << std::setw(8) << stats.objectsInUse
+         << " free=" << std::setw(8) << stats.freeObjects
+         << " RSS=" << std::fixed << std::setprecision(1) << std::setw(7)
+         << residentMB() << " MB" << endl;
+}
+
+/**
+ * @brief Add 4M keys, remove the oldest 90% in a burst, then churn
+ * @param label name of the allocator config
+ * @param config allocator config to use
+ */
+void benchChurnWith(const std::string& label, const SimpleAllocatorConfig& config) {
+    const int n = 4000000;
+    const int kept = n / 10;
+
+    cout << "  -- " << label << endl;
+    SimpleAllocator allocator(sizeof(AVL<int>::BinTreeNode), config);
+    {
+        AVL<int> avl(&allocator);
+        for (int i = 0; i < n; ++i)
+            avl.add(i);
+        printChurnRow("add 4M", allocator);
+
+        Stopwatch sw;
+        for (int i = 0; i < n - kept; ++i)
+            avl.remove(i);
+        printChurnRow("remove oldest 90%", allocator);
+        printRow("remove time", n - kept, sw.elapsedMs());
+
+        // a sliding window: add a new key for every old key removed
+        for (int i = n; i < n + kept; ++i) {
+            avl.add(i);
+            avl.remove(i - kept);
+        }
+        printChurnRow("slide window by 400k", allocator);
+    }
+    printChurnRow("tree destroyed", allocator);
+}
+
+/**
+ * @brief Memory held after a burst of removes, with fixed-size pages and
+ *        with pages that grow and are released once they are free
+ */
+void benchChurn() {
+    benchChurnWith("fixed pages of 1024",
+                   SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0));
+    benchChurnWith("growable pages, reclaim > 64k free",
+                   SimpleAllocatorConfig(false, 64, 0,
+                                         SimpleAllocatorConfig::HeaderBlockInfo(),
+                                         0, 0, false, false, DEFAULT_THREAD_CACHE_SIZE,
+                                         65536, 65536));
+}
+
+/**
+ * @brief Alloc/free cycles through allocators with their options chosen at
+ *        compile time vs the same options in a runtime SimpleAllocatorConfig
+ *        - release: no header, no pad, no checks
+ *        - debug: basic header, 8 pad bytes and all the debug checks
+ */
+void benchPolicyAllocator() {
+    const size_t objectSize = sizeof(BST<int>::BinTreeNode);
+    const int n = 100000;
+    const int rounds = 50;
+
+    cout << "Release (bare free list):" << endl;
+    SimpleAllocator runtimeRelease(objectSize,
+                                   SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0));
+    printRow("SimpleAllocator", 2 * n * rounds,
+             timeAllocFreeWith(runtimeRelease, n, rounds));
+    PolicyAllocator<> policyRelease(objectSize, BST_OBJECTS_PER_PAGE);
+    printRow("PolicyAllocator<>", 2 * n * rounds,
+             timeAllocFreeWith(policyRelease, n, rounds));
+
+    cout << "Debug (basic header, 8 pad bytes, checks):" << endl;
+    SimpleAllocator runtimeDebug(objectSize,
+                                 SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0,
+                                                       SimpleAllocatorConfig::HeaderBlockInfo(
+                                                           SimpleAllocatorConfig::BASIC_HEADER),
+                                                       0, 8, true));
+    printRow("SimpleAllocator", 2 * n * rounds,
+             timeAllocFreeWith(runtimeDebug, n, rounds));
+    PolicyAllocator<DebugCheckPolicy, BasicHeaderPolicy, 8> policyDebug(objectSize,
+                                                                        BST_OBJECTS_PER_PAGE);
+    printRow("PolicyAllocator<Debug...>", 2 * n * rounds,
+             timeAllocFreeWith(policyDebug, n, rounds));
+}
+
+/**
+ * @brief Count the nodes of a tree that straddle two cache lines
+ * @param tree root of the tree
+ * @return number of straddling nodes
+ */
+unsigned long countStraddlingNodes(AVL<int>::BinTree tree) {
+    if (tree == nullptr)
+        return 0;
+    uintptr_t first = reinterpret_cast<uintptr_t>(tree);
+    uintptr_t last = first + sizeof(AVL<int>::BinTreeNode) - 1;
+    return (first / BST_CACHE_LINE_SIZE != last / BST_CACHE_LINE_SIZE) +
+           countStraddlingNodes(tree->left) + countStraddlingNodes(tree->right);
+}
+
+/**
+ * @brief Time random finds in a 10M-node AVL whose nodes come from an
+ *        allocator with the given config
+ * @param label what was measured
+ * @param config the allocator configuration
+ * @param keys the sorted keys
+ * @param queries the keys to look up
+ */
+void benchAlignedFinds(const std::string& label, const SimpleAllocatorConfig& config,
+                       const std::vector<int>& keys, const std::vector<int>& queries) {
+    SimpleAllocator allocator(sizeof(AVL<int>::BinTreeNode), config);
+    AVL<int> avl(keys.begin(), keys.end(), &allocator);
+
+    unsigned compares = 0;
+    unsigned found = 0;
+    Stopwatch sw;
+    for (int query : queries)
+        found += avl.find(query, compares);
+    printRow(label, static_cast<int>(queries.size()), sw.elapsedMs());
+    cout << "  " << std::setw(28) << "" << " straddling nodes: " << std::fixed
+         << std::setprecision(1) << 100.0 * countStraddlingNodes(avl.root()) / keys.size()
+         << "%, found " << found << endl;
+    avl.clear();
+}
+
+/**
+ * @brief Random finds in a 10M-node AVL with unaligned nodes, nodes aligned
+ *        to their size (what a BST's own allocator does), and nodes on huge
+ *        (and NUMA-local) pages
+ */
+void benchAlignment() {
+    const int n = 10000000;
+    const int lookups = 2000000;
+
+    // even keys, so that odd lookups miss
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i;
+    std::vector<int> queries(lookups);
+    Utils::srand(8, 1);
+    for (int i = 0; i < lookups; ++i)
+        queries[i] = static_cast<int>(Utils::rand() % (2 * n));
+
+    const unsigned nodeSize = sizeof(AVL<int>::BinTreeNode);
+    SimpleAllocatorConfig::HeaderBlockInfo noHeader;
+    benchAlignedFinds("no alignment", SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0),
+                      keys, queries);
+    benchAlignedFinds("aligned to node size",
+                      SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0, noHeader, nodeSize),
+                      keys, queries);
+    benchAlignedFinds("aligned, huge pages",
+                      SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0, noHeader, nodeSize,
+                                            0, false, false, DEFAULT_THREAD_CACHE_SIZE, 0, 0,
+                                            true),
+                      keys, queries);
+    benchAlignedFinds("aligned, huge, NUMA-local",
+                      SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0, noHeader, nodeSize,
+                                            0, false, false, DEFAULT_THREAD_CACHE_SIZE, 0, 0,
+                                            true, true),
+                      keys, queries);
+}
+
+/**
+ * @brief Alloc/free cycles with and without isProfiling, then the profile
+ *        of the profiled allocator as JSON
+ *        - the disabled path costs one branch per call
+ */
+void benchProfile() {
+    const int n = 100000;
+    const int rounds = 50;
+    SimpleAllocatorConfig::HeaderBlockInfo noHeader;
+
+    SimpleAllocator plain(sizeof(BST<int>::BinTreeNode),
+                          SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0));
+    printRow("isProfiling = false", 2 * n * rounds, timeAllocFreeWith(plain, n, rounds));
+
+    SimpleAllocator profiled(sizeof(BST<int>::BinTreeNode),
+                             SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0, noHeader, 0, 0,
+                                                   false, false, DEFAULT_THREAD_CACHE_SIZE, 0,
+                                                   0, false, false, true));
+    printRow("isProfiling = true", 2 * n * rounds, timeAllocFreeWith(profiled, n, rounds));
+
+    // leave the pages partly used so that the page fill has something to show
+    for (int i = 0; i < n; ++i) {
+        void* p = profiled.allocate();
+        if (i % 3 != 0)
+            profiled.free(p);
+    }
+    cout << "  " << profiled.getProfile().toJson() << endl;
+}
+
+/**
+ * @brief Time random adds then random finds in a tree, and report the
+ *        memory it holds
+ * @tparam Tree BST<int> or CompactBST<int>
+ * @param label what was measured
+ * @param keys the keys in the order they are added
+ * @param queries the keys to look up
+ */
+template <typename Tree>
+void benchTreeLayout(const std::string& label, const std::vector<int>& keys,
+                     const std::vector<int>& queries) {
+#if defined(__GLIBC__)
+    // hand back the memory freed by the last tree, so that it is not reused
+    malloc_trim(0);
+#endif
+    double startMB = residentMB();
+    Tree tree;
+    {
+        Stopwatch sw;
+        for (int key : keys)
+            tree.add(key);
+        printRow(label + "::add", static_cast<int>(keys.size()), sw.elapsedMs());
+    }
+    double treeMB = residentMB() - startMB;
+
+    unsigned compares = 0;
+    unsigned found = 0;
+    {
+        Stopwatch sw;
+        for (int query : queries)
+            found += tree.find(query, compares);
+        printRow(label + "::find", static_cast<int>(queries.size()), sw.elapsedMs());
+    }
+    cout << "  " << std::setw(28) << "" << " memory: " << std::fixed << std::setprecision(0)
+         << treeMB << " MB (" << std::setprecision(1) << treeMB * 1024 * 1024 / keys.size()
+         << " bytes/node), found " << found << endl;
+}
+
+/**
+ * @brief Random adds and finds on 50M int keys in a BST (pointer links)
+ *        and a CompactBST (32-bit index links)
+ */
+void benchCompactBST() {
+    const int n = 50000000;
+    const int lookups = 5000000;
+
+    // even keys in a random order, so that odd lookups miss
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::rand() % (i + 1)]);
+    std::vector<int> queries(lookups);
+    for (int i = 0; i < lookups; ++i)
+        queries[i] = static_cast<int>(Utils::rand() % (2 * n));
+
+    benchTreeLayout<BST<int>>("BST<int>", keys, queries);
+    benchTreeLayout<CompactBST<int>>("CompactBST<int>", keys, queries);
+}
+
+/**
+ * @brief Time requests that each build a tree of sorted keys, look up a
+ *        few of them and throw the tree away
+ * @param label what was measured
+ * @param requests number of requests
+ * @param request builds, queries and destroys (or clears) one tree
+ */
+template <typename Request>
+void benchRequests(const std::string& label, int requests, Request request) {
+    unsigned found = 0;
+    Stopwatch sw;
+    for (int r = 0; r < requests; ++r)
+        found += request();
+    double ms = sw.elapsedMs();
+    cout << "  " << std::left << std::setw(36) << label << std::right << std::fixed
+         << std::setprecision(2) << std::setw(10) << ms / requests << " ms/request"
+         << std::setw(10) << std::setprecision(0) << requests * 1000.0 / ms << " requests/s"
+         << " (found " << found << ")" << endl;
+}
+
+/**
+ * @brief Build and throw away 1M-node trees, one per request, with nodes
+ *        from a shared pool (freed one by one), a pool owned by the tree,
+ *        an arena owned by the tree, and one arena tree cleared per request
+ */
+void benchArena() {
+    const int n = 1000000;
+    const int requests = 50;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+
+    // look up a few keys so that the tree is used
+    auto query = [](const BST<int>& tree) {
+        unsigned compares = 0;
+        unsigned found = 0;
+        for (int key = 0; key < 1000000; key += 10007)
+            found += tree.find(key, compares);
+        return found;
+    };
+
+    SimpleAllocator shared(sizeof(BST<int>::BinTreeNode),
+                           SimpleAllocatorConfig(false, BST_OBJECTS_PER_PAGE, 0));
+    benchRequests("shared pool (nodes freed one by one)", requests, [&]() {
+        BST<int> tree(keys.begin(), keys.end(), &shared);
+        return query(tree);
+    });
+    benchRequests("own pool", requests, [&]() {
+        BST<int> tree(keys.begin(), keys.end());
+        return query(tree);
+    });
+    benchRequests("own arena", requests, [&]() {
+        BST<int> tree(BST<int>::arenaConfig());
+        tree.build(keys.begin(), keys.end());
+        return query(tree);
+    });
+    BST<int> reused(BST<int>::arenaConfig());
+    benchRequests("one arena tree, cleared", requests, [&]() {
+        reused.build(keys.begin(), keys.end());
+        unsigned found = query(reused);
+        reused.clear();
+        return found;
+    });
+}
+
+/**
+ * @brief Time reader threads that each look up a share of the keys while
+ *        one writer thread keeps adding and removing other keys
+ * @param label what was measured
+ * @param readers number of reader threads
+ * @param keys the keys to look up, split between the readers
+ * @param find looks up a key
+ * @param update adds and then removes the i-th update key
+ */
+template <typename Find, typename Update>
+void benchMixedReads(const std::string& label, int readers, const std::vector<int>& keys,
+                     Find find, Update update) {
+    std::atomic<bool> isDone(false);
+    unsigned updates = 0;
+    std::thread writer([&]() {
+        for (; !isDone; updates += 2)
+            update(updates / 2);
+    });
+
+    Stopwatch sw;
+    std::atomic<unsigned> found(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < readers; ++t) {
+        workers.emplace_back([&, t]() {
+            unsigned n = 0;
+            for (size_t i = t; i < keys.size(); i += readers)
+                n += find(keys[i]);
+            found += n;
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    double ms = sw.elapsedMs();
+    isDone = true;
+    writer.join();
+
+    // the reads are split, so perfect scaling halves the time per doubling
+    printRow(label + " x" + std::to_string(readers), static_cast<int>(keys.size()), ms);
+    cout << "    (found " << found << ", " << updates << " updates meanwhile)" << endl;
+}
+
+/**
+ * @brief Finds from several threads while one thread adds and removes keys,
+ *        on a ConcurrentBST (readers never block) and on a BST behind a
+ *        mutex and behind a shared mutex (readers wait out every update)
+ */
+void benchConcurrentReads() {
+    const int n = 1000000;
+    const int lookups = 1000000;
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+
+    // the trees hold the even keys and the writer churns the odd ones
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::randInt(0, i)]);
+    std::vector<int> queries(lookups);
+    for (int& query : queries)
+        query = keys[Utils::randInt(0, n - 1)];
+    auto churn = [](unsigned i) { return static_cast<int>(i % 1000 * 2000 + 1); };
+
+    ConcurrentBST<int> concurrent;
+    BST<int> locked;
+    for (int key : keys) {
+        concurrent.add(key);
+        locked.add(key);
+    }
+    std::mutex mutex;
+    std::shared_mutex sharedMutex;
+
+    for (int readers = 1; readers <= 16; readers *= 2) {
+        benchMixedReads("ConcurrentBST", readers, queries,
+            [&](int key) {
+                unsigned compares = 0;
+                return concurrent.find(key, compares);
+            },
+            [&](unsigned i) {
+                concurrent.add(churn(i));
+                concurrent.remove(churn(i));
+            });
+        benchMixedReads("BST + mutex", readers, queries,
+            [&](int key) {
+                unsigned compares = 0;
+                std::lock_guard<std::mutex> lock(mutex);
+                return locked.find(key, compares);
+            },
+            [&](unsigned i) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    locked.add(churn(i));
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                locked.remove(churn(i));
+            });
+        benchMixedReads("BST + shared_mutex", readers, queries,
+            [&](int key) {
+                unsigned compares = 0;
+                std::shared_lock<std::shared_mutex> lock(sharedMutex);
+                return locked.find(key, compares);
+            },
+            [&](unsigned i) {
+                {
+                    std::unique_lock<std::shared_mutex> lock(sharedMutex);
+                    locked.add(churn(i));
+                }
+                std::unique_lock<std::shared_mutex> lock(sharedMutex);
+                locked.remove(churn(i));
+            });
+    }
+}
+
+/**
+ * @brief Time threads that each add, find and then remove their own keys
+ *        in a tree that already holds other keys
+ * @param label what was measured
+ * @param threads number of threads
+ * @param keys the keys to add, find and remove, dealt out to the threads
+ * @param add adds a key
+ * @param find looks up a key
+ * @param remove removes a key
+ */
+template <typename Add, typename Find, typename Remove>
+void benchWriters(const std::string& label, int threads, const std::vector<int>& keys,
+                  Add add, Find find, Remove remove) {
+    Stopwatch sw;
+    std::atomic<unsigned> found(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            unsigned n = 0;
+            for (size_t i = t; i < keys.size(); i += threads)
+                add(keys[i]);
+            for (size_t i = t; i < keys.size(); i += threads)
+                n += find(keys[i]);
+            for (size_t i = t; i < keys.size(); i += threads)
+                remove(keys[i]);
+            found += n;
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    // the work is split, so perfect scaling halves the time per doubling
+    printRow(label + " x" + std::to_string(threads), 3 * static_cast<int>(keys.size()),
+             sw.elapsedMs());
+    if (found != keys.size())
+        cout << "    (found " << found << " of " << keys.size() << ")" << endl;
+}
+
+/**
+ * @brief Adds, finds and removes of disjoint keys from 1 to 32 threads into
+ *        a 500K-node tree, on a MultiWriterBST (no locks) and on a BST
+ *        behind a mutex
+ *        - uniform keys land all over the tree, while skewed keys all land
+ *          under the same 0.4% of it, so the threads share most of the path
+ */
+void benchMultiWriter() {
+    const int n = 500000;
+    const unsigned m = 1u << 18;
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+
+    // the trees hold multiples of 64 and the threads add the others
+    std::vector<int> held(n);
+    for (int i = 0; i < n; ++i)
+        held[i] = 64 * i;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(held[i], held[Utils::randInt(0, i)]);
+
+    // the odd multiplier scrambles 0 to m - 1 so no thread adds in order
+    std::vector<int> uniform(m);
+    std::vector<int> skewed(m);
+    for (unsigned i = 0; i < m; ++i) {
+        unsigned q = i * 40503u % m;
+        uniform[i] = static_cast<int>(64 * (1ull * q * n / m) + 1 + q % 63);
+        skewed[i] = static_cast<int>(q + q / 63 + 1);
+    }
+
+    for (const std::vector<int>* keys : {&uniform, &skewed}) {
+        cout << (keys == &uniform ? "  uniform keys:" : "  skewed keys:") << endl;
+        for (int threads = 1; threads <= 32; threads *= 2) {
+            MultiWriterBST<int> multi;
+            for (int key : held)
+                multi.add(key);
+            benchWriters("MultiWriterBST", threads, *keys,
+                         [&](int key) { multi.add(key); },
+                         [&](int key) {
+                             unsigned compares = 0;
+                             return multi.find(key, compares);
+                         },
+                         [&](int key) { multi.remove(key); });
+
+            BST<int> locked;
+            for (int key : held)
+                locked.add(key);
+            std::mutex mutex;
+            benchWriters("BST + mutex", threads, *keys,
+                         [&](int key) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             locked.add(key);
+                         },
+                         [&](int key) {
+                             unsigned compares = 0;
+                             std::lock_guard<std::mutex> lock(mutex);
+                             return locked.find(key, compares);
+                         },
+                         [&](int key) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             locked.remove(key);
+                         });
+        }
+    }
+}
+
+/**
+ * @brief Moving the lower half of a 10M-key AVL into a tree of its own and
+ *        back, with split() and join() against a loop of removes and adds
+ */
+void benchSplitJoin() {
+    const int n = 10000000;
+    const int pivot = n / 2;
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+
+    {
+        AVL<int> tree(keys.begin(), keys.end());
+        Stopwatch sw;
+        std::pair<AVL<int>, AVL<int>> halves = tree.split(pivot);
+        printRow("AVL split at 5M", 1, sw.elapsedMs());
+        cout << "    (sizes " << halves.first.size() << " and " << halves.second.size()
+             << ", heights " << halves.first.height() << " and "
+             << halves.second.height() << ")" << endl;
+
+        Stopwatch joinSw;
+        AVL<int> joined = AVL<int>::join(std::move(halves.first), std::move(halves.second));
+        printRow("AVL join back", 1, joinSw.elapsedMs());
+        cout << "    (size " << joined.size() << ", height " << joined.height() << ")"
+             << endl;
+    }
+    {
+        AVL<int> tree(keys.begin(), keys.end());
+        AVL<int> lower;
+        Stopwatch sw;
+        for (int key = 0; key < pivot; ++key) {
+            tree.remove(key);
+            lower.add(key);
+        }
+        printRow("AVL remove/add loop", pivot, sw.elapsedMs());
+
+        Stopwatch joinSw;
+        for (int key = 0; key < pivot; ++key) {
+            lower.remove(key);
+            tree.add(key);
+        }
+        printRow("AVL remove/add back", pivot, joinSw.elapsedMs());
+        cout << "    (size " << tree.size() << ", height " << tree.height() << ")" << endl;
+    }
+}
+
+/**
+ * @brief Union, intersection and difference of two 10M-key trees (the even
+ *        keys and the keys that are 0 or 1 mod 4, so half are in both) by
+ *        merging in order, against adding or removing the keys one at a time
+ *        - both span the same range, so the adds land all over the tree
+ */
+void benchSetOperations() {
+    const int n = 10000000;
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+
+    std::vector<int> twos(n);
+    std::vector<int> fours(n);
+    for (int i = 0; i < n; ++i) {
+        twos[i] = 2 * i;
+        fours[i] = 4 * (i / 2) + i % 2;
+    }
+    BST<int> other(fours.begin(), fours.end());
+
+    {
+        BST<int> tree(twos.begin(), twos.end());
+        Stopwatch sw;
+        unsigned duplicates = 0;
+        for (int key : fours) {
+            try {
+                tree.add(key);
+            } catch (const BSTException&) {
+                ++duplicates;
+            }
+        }
+        printRow("union by add", n, sw.elapsedMs());
+        cout << "    (size " << tree.size() << ", height " << tree.height() << ", "
+             << duplicates << " duplicates thrown)" << endl;
+    }
+    for (unsigned threads = 1; threads <= 8; threads *= 2) {
+        BST<int> tree(twos.begin(), twos.end());
+        Stopwatch sw;
+        tree.unionWith(other, threads);
+        printRow("unionWith x" + std::to_string(threads), 2 * n, sw.elapsedMs());
+        if (threads == 1)
+            cout << "    (size " << tree.size() << ", height " << tree.height() << ")"
+                 << endl;
+    }
+    {
+        BST<int> tree(twos.begin(), twos.end());
+        Stopwatch sw;
+        unsigned missing = 0;
+        for (int key : fours) {
+            try {
+                tree.remove(key);
+            } catch (const BSTException&) {
+                ++missing;
+            }
+        }
+        printRow("difference by remove", n, sw.elapsedMs());
+        cout << "    (size " << tree.size() << ", " << missing << " misses thrown)" << endl;
+    }
+    {
+        BST<int> tree(twos.begin(), twos.end());
+        Stopwatch sw;
+        tree.subtract(other);
+        printRow("subtract", 2 * n, sw.elapsedMs());
+    }
+    {
+        BST<int> tree(twos.begin(), twos.end());
+        Stopwatch sw;
+        tree.intersectWith(other);
+        printRow("intersectWith", 2 * n, sw.elapsedMs());
+        cout << "    (size " << tree.size() << ")" << endl;
+    }
+}
+
+/**
+ * @brief Time an ingest stream where half of the keys are duplicates
+ *        through the throwing and the non-throwing calls
+ * @tparam Tree type of tree to ingest into
+ * @param name name of the tree for the labels
+ * @param stream the keys to add, then to remove, in order
+ */
+template <typename Tree>
+void benchIngest(const std::string& name, const std::vector<int>& stream) {
+    const int n = static_cast<int>(stream.size());
+    {
+        Tree tree;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        unsigned duplicates = 0;
+        for (int key : stream) {
+            try {
+                tree.add(key);
+            } catch (const BSTException&) {
+                ++duplicates;
+            }
+        }
+        printAllocRow(name + "::add + catch", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+        before = HeapAllocations;
+        sw = Stopwatch();
+        unsigned misses = 0;
+        for (int key : stream) {
+            try {
+                tree.remove(key);
+            } catch (const BSTException&) {
+                ++misses;
+            }
+        }
+        printAllocRow(name + "::remove + catch", n, sw.elapsedMs(),
+                      HeapAllocations - before);
+        cout << "    (" << duplicates << " duplicates, " << misses << " misses thrown)"
+             << endl;
+    }
+    {
+        Tree tree;
+        unsigned long long before = HeapAllocations;
+        Stopwatch sw;
+        unsigned duplicates = 0;
+        for (int key : stream)
+            duplicates += !tree.tryAdd(key);
+        printAllocRow(name + "::tryAdd", n, sw.elapsedMs(), HeapAllocations - before);
+        before = HeapAllocations;
+        sw = Stopwatch();
+        unsigned misses = 0;
+        for (int key : stream)
+            misses += !tree.tryRemove(key);
+        printAllocRow(name + "::tryRemove", n, sw.elapsedMs(), HeapAllocations - before);
+        cout << "    (" << duplicates << " duplicates, " << misses << " misses returned)"
+             << endl;
+    }
+}
+
+/**
+ * @brief Ingest 1M keys each sent twice in a shuffled 2M-key stream,
+ *        with exceptions vs return values for the duplicates and misses
+ */
+void benchTryAdd() {
+    const int n = 2000000;
+    std::vector<int> stream(n);
+    for (int i = 0; i < n; ++i)
+        stream[i] = i / 2;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(stream[i], stream[Utils::rand() % (i + 1)]);
+
+    benchIngest<BST<int>>("BST", stream);
+    benchIngest<AVL<int>>("AVL", stream);
+}
+
+/**
+ * @brief Copying a 20M-key tree with 1 to 16 threads, by the copy
+ *        constructor and by assign()
+ */
+void benchParallelCopy() {
+    const int n = 20000000;
+    unsigned cores = std::thread::hardware_concurrency();
+    cout << "  (" << cores << " hardware threads)" << endl;
+
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = i;
+    BST<int> tree(keys.begin(), keys.end());
+    keys = std::vector<int>();
+
+    // a first copy so that every timed copy gets pages the process has had
+    { BST<int> warmUp(tree, 1); }
+    for (unsigned threads = 1; threads <= 16; threads *= 2) {
+        Stopwatch sw;
+        BST<int> copy(tree, threads);
+        printRow("BST(rhs) x" + std::to_string(threads), n, sw.elapsedMs());
+    }
+    BST<int> target;
+    for (unsigned threads = 1; threads <= 16; threads *= 2) {
+        Stopwatch sw;
+        target.assign(tree, threads);
+        printRow("assign(rhs) x" + std::to_string(threads), n, sw.elapsedMs());
+    }
+    cout << "    (size " << target.size() << ", height " << target.height() << ")" << endl;
+}
+
+/**
+ * @brief 1000 snapshots of a 1M-key tree taken between 1M updates,
+ *        sharing nodes against copying the whole tree each time
+ */
+void benchSnapshots() {
+    const int n = 1000000;
+    const int updates = 1000000;
+    const int snapshots = 1000;
+
+    // odd keys in a shuffled order, so that each update can remove one and
+    // add an even one that is not in the tree
+    std::vector<int> keys(n);
+    for (int i = 0; i < n; ++i)
+        keys[i] = 2 * i + 1;
+    Utils::srand(8, 1);
+    for (int i = n - 1; i > 0; --i)
+        std::swap(keys[i], keys[Utils::rand() % (i + 1)]);
+
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+    SimpleAllocator allocator(sizeof(PersistentBST<int>::Node), config);
+    {
+        PersistentBST<int> tree(&allocator);
+        for (int key : keys)
+            tree.add(key);
+        std::vector<PersistentBST<int>> taken;
+        taken.reserve(snapshots);
+
+        double snapshotMs = 0;
+        double worstSnapshotMs = 0;
+        Stopwatch sw;
+        for (int i = 0; i < updates; ++i) {
+            if (i % (updates / snapshots) == 0) {
+                Stopwatch snapshotSw;
+                taken.push_back(tree.snapshot());
+                double ms = snapshotSw.elapsedMs();
+                snapshotMs += ms;
+                if (ms > worstSnapshotMs)
+                    worstSnapshotMs = ms;
+            }
+            tree.remove(keys[i]);
+            tree.add(2 * keys[i]);
+        }
+        double totalMs = sw.elapsedMs();
+        printRow("PersistentBST::snapshot", snapshots, snapshotMs);
+        cout << "    (worst " << std::fixed << std::setprecision(4) << worstSnapshotMs
+             << " ms)" << endl;
+        printRow("remove + add with snapshots", updates, totalMs - snapshotMs);
+        unsigned inUse = allocator.getStats().objectsInUse;
+        cout << "    (" << inUse << " nodes in use for the tree and " << taken.size()
+             << " snapshots, " << std::setprecision(1)
+             << (inUse - n) * sizeof(PersistentBST<int>::Node) / 1e6 / snapshots
+             << " MB per snapshot on top of the tree)" << endl;
+
+        taken.clear();
+        cout << "    (" << allocator.getStats().objectsInUse
+             << " nodes in use once the snapshots are gone)" << endl;
+        Stopwatch plainSw;
+        for (int i = 0; i < updates; ++i) {
+            tree.remove(2 * keys[i]);
+            tree.add(keys[i]);
+        }
+        printRow("remove + add, no snapshots", updates, plainSw.elapsedMs());
+    }
+
+    // a full copy of a BST per snapshot, timed on a few and scaled up
+    {
+        BST<int> tree;
+        for (int key : keys)
+            tree.add(key);
+        const int copies = 10;
+        Stopwatch sw;
+        for (int i = 0; i < copies; ++i) {
+            BST<int> copy(tree, 1);
+        }
+        double ms = sw.elapsedMs();
+        printRow("BST(rhs) as a snapshot", copies, ms);
+        cout << "    (" << std::setprecision(1)
+             << n * sizeof(BST<int>::BinTreeNode) / 1e6 << " MB per snapshot, "
+             << ms / copies * snapshots / 1000 << " s and "
+             << n * sizeof(BST<int>::BinTreeNode) / 1e6 * snapshots / 1000
+             << " GB for " << snapshots << ")" << endl;
+    }
+}
+
+/**
+ * The main function
+ * @param argc number of command line arguments
+ * @param argv array of command line arguments
+ */
+int main(int argc, char* argv[]) {
+    // benchmark number
+    int bench = 0;
+
+    // check for command line arguments
+    if (argc > 1)
+        bench = atoi(argv[1]);
+
+    switch (bench) {
+    case 1:
+        cout << "=== Bench sorted adds into BST vs AVL ===" << endl;
+        benchSortedAdds();
+        break;
+    case 2:
+        cout << "=== Bench pooled vs C++ allocation of BST nodes ===" << endl;
+        benchAllocator();
+        break;
+    case 3:
+        cout << "=== Bench bulk build vs repeated adds ===" << endl;
+        benchBuild();
+        break;
+    case 4:
+        cout << "=== Bench core BST operations ===" << endl;
+        benchCoreOps();
+        break;
+    case 5:
+        cout << "=== Bench in-order traversal ===" << endl;
+        benchTraversal();
+        break;
+    case 6:
+        cout << "=== Bench range count queries ===" << endl;
+        benchRangeCount();
+        break;
+    case 7:
+        cout << "=== Bench adding std::string keys ===" << endl;
+        benchStringAdds();
+        break;
+    case 8:
+        cout << "=== Bench transparent lookups of std::string keys ===" << endl;
+        benchTransparentFind();
+        break;
+    case 9:
+        cout << "=== Bench finds in a frozen snapshot ===" << endl;
+        benchFrozenFind();
+        break;
+    case 10:
+        cout << "=== Bench allocating from many threads ===" << endl;
+        benchThreadCache();
+        break;
+    case 11:
+        cout << "=== Bench copying and clearing 10M-node trees ===" << endl;
+        benchCopyClear();
+        break;
+    case 12:
+        cout << "=== Bench memory held after churn ===" << endl;
+        benchChurn();
+        break;
+    case 13:
+        cout << "=== Bench compile-time vs runtime allocator options ===" << endl;
+        benchPolicyAllocator();
+        break;
+    case 14:
+        cout << "=== Bench finds with aligned and huge-page nodes ===" << endl;
+        benchAlignment();
+        break;
+    case 15:
+        cout << "=== Bench the cost of profiling an allocator ===" << endl;
+        benchProfile();
+        break;
+    case 16:
+        cout << "=== Bench pointer vs 32-bit index nodes on 50M keys ===" << endl;
+        benchCompactBST();
+        break;
+    case 17:
+        cout << "=== Bench building and throwing away 1M-node trees ===" << endl;
+        benchArena();
+        break;
+    case 18:
+        cout << "=== Bench reads while another thread updates a 1M-node tree ===" << endl;
+        benchConcurrentReads();
+        break;
+    case 19:
+        cout << "=== Bench adds and removes from 1 to 32 threads at once ===" << endl;
+        benchMultiWriter();
+        break;
+    case 20:
+        cout << "=== Bench split and join vs removes and adds on 10M keys ===" << endl;
+        benchSplitJoin();
+        break;
+    case 21:
+        cout << "=== Bench set operations on 10M and 10M keys ===" << endl;
+        benchSetOperations();
+        break;
+    case 22:
+        cout << "=== Bench a 2M-key ingest stream with 50% duplicates ===" << endl;
+        benchTryAdd();
+        break;
+    case 23:
+        cout << "=== Bench copying a 20M-key tree with 1 to 16 threads ===" << endl;
+        benchParallelCopy();
+        break;
+    case 24:
+        cout << "=== Bench 1000 snapshots between 1M updates of a 1M-key tree ===" << endl;
+        benchSnapshots();
+        break;
+    default:
+        cout << "Please select a valid benchmark." << endl;
+        break;
+    }
+
+    cout << "========================================" << endl;
+
+    return 0;
+}
@@ -10,7 +10,14 @@
 #define FUDGE 4
 
 #include "BST.h"
+#include "AVL.h"
+#include "FrozenBST.h"
+#include "CompactBST.h"
+#include "ConcurrentBST.h"
+#include "MultiWriterBST.h"
+#include "PersistentBST.h"
 #include "SimpleAllocator.h"
+#include "PolicyAllocator.h"
 #include "prng.h"
 #include <iostream>
 #include <map>
@@ -21,6 +28,11 @@
 #include <typeinfo>
 #include <sstream>
 #include <cstring>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <string_view>
 
 using std::cout;
 using std::endl;
@@ -618,14 +630,1683 @@ template <typename T> void testSubscript(BST<T>& bst, int index) {
     cout << endl;
 }
 
+/**
+ * @brief A value whose copies start throwing once a number of them is used up
+ */
+struct CopyLimited {
+    int value;
+
+    // the copies left before one throws (shared by all threads)
+    static std::atomic<int> copiesLeft;
+
+    CopyLimited(int v) : value(v) {}
+    CopyLimited(const CopyLimited& rhs) : value(rhs.value) {
+        if (copiesLeft.fetch_sub(1) <= 0)
+            throw std::runtime_error("No copies left");
+    }
+    bool operator<(const CopyLimited& rhs) const { return value < rhs.value; }
+};
+std::atomic<int> CopyLimited::copiesLeft(0);
+
+/**
+ * @brief Build a BST from a sorted range of ints
+ *        - need to detect the BSTExceptions
+ *        - a bad range leaves the tree unchanged
+ *        - a value whose copy throws leaves the tree empty, with every node
+ *          and block given back
+ * @param bst BST to build
+ * @param size number of sorted ints to build from
+ */
+template <typename T> void testBuild(BST<T>& bst, int size) {
+    // print a title of the test
+    cout << "Running testBuild..." << endl;
+    cout << endl;
+
+    // generate size number of sorted ints
+    std::vector<int> data(size);
+    for (int i = 0; i < size; ++i)
+        data[i] = i;
+
+    bst.build(data.begin(), data.end());
+    cout << "BST after building from " << size << " elements:" << endl << endl;
+    printBSTStats(bst);
+    printBST(bst);
+
+    // try to build from ranges that are not strictly increasing
+    const int unsorted[] = {0, 2, 1};
+    const int duplicates[] = {0, 1, 1};
+    const int* ranges[] = {unsorted, duplicates};
+    for (const int* range : ranges) {
+        try {
+            bst.build(range, range + 3);
+        } catch (BSTException& e) {
+            cout << "  !!! BSTException: " << e.what() << endl;
+        }
+    }
+    cout << endl;
+    printBSTStats(bst);
+
+    // copying a value throws part way through the build
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+    SimpleAllocator allocator(sizeof(BST<CopyLimited>::BinTreeNode), config);
+    std::vector<CopyLimited> limited(data.begin(), data.end());
+    CopyLimited::copiesLeft = size;
+    BST<CopyLimited> built(limited.begin(), limited.end(), &allocator);
+    cout << "  built from CopyLimited: size " << built.size() << ", in use "
+         << allocator.getStats().objectsInUse << endl;
+    CopyLimited::copiesLeft = size / 2;
+    try {
+        built.build(limited.begin(), limited.end());
+    } catch (std::runtime_error& e) {
+        cout << "  !!! std::runtime_error: " << e.what() << endl;
+    }
+    cout << "  after the failed build: size " << built.size() << ", in use "
+         << allocator.getStats().objectsInUse << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Walk the values of a BST with its iterators
+ *        - forwards with a range-based for loop
+ *        - backwards with the reverse iterators
+ *        - backwards from the end with the decrement operator
+ * @param bst BST to walk
+ */
+template <typename T, typename Compare>
+void testIterators(const BST<T, Compare>& bst) {
+    // print a title of the test
+    cout << "Running testIterators..." << endl;
+    cout << endl;
+
+    cout << "  In order:";
+    for (const T& value : bst)
+        cout << " " << value;
+    cout << endl;
+
+    cout << "  Reverse order:";
+    for (typename BST<T, Compare>::const_reverse_iterator it = bst.rbegin();
+         it != bst.rend(); ++it)
+        cout << " " << *it;
+    cout << endl;
+
+    cout << "  Last 3 from the end:";
+    typename BST<T, Compare>::const_iterator it = bst.end();
+    for (int i = 0; i < 3 && it != bst.begin(); ++i)
+        cout << " " << *--it;
+    cout << endl << endl;
+}
+
+/**
+ * @brief Test the rank, range count and bound queries of a BST
+ * @param bst BST to query
+ * @param lo smallest value of the range to query
+ * @param hi largest value of the range to query
+ */
+template <typename T> void testRange(const BST<T>& bst, const T& lo, const T& hi) {
+    // print a title of the test
+    cout << "Running testRange..." << endl;
+    cout << endl;
+
+    cout << "  Rank of " << lo << " is " << bst.rank(lo)
+         << ", rank of " << hi << " is " << bst.rank(hi) << endl;
+    cout << "  Values in [" << lo << ", " << hi << "]: "
+         << bst.countInRange(lo, hi) << endl;
+
+    // the bounds of an empty range are not in order so they cannot be walked
+    if (!(hi < lo)) {
+        cout << "  Walking from lowerBound(" << lo << ") to upperBound(" << hi << "):";
+        typename BST<T>::const_iterator last = bst.upperBound(hi);
+        for (typename BST<T>::const_iterator it = bst.lowerBound(lo); it != last; ++it)
+            cout << " " << *it;
+        cout << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Print the stats of an allocator
+ * @tparam Allocator SimpleAllocator or a PolicyAllocator
+ * @param allocator allocator to print stats
+ */
+template <typename Allocator>
+void printAllocatorStats(const Allocator& allocator) {
+    SimpleAllocatorStats stats = allocator.getStats();
+    cout << "  pages: " << stats.pagesInUse
+         << ", in use: " << stats.objectsInUse
+         << ", free: " << stats.freeObjects
+         << ", most: " << stats.mostObjects
+         << ", allocs: " << stats.allocations
+         << ", deallocs: " << stats.deallocations << endl;
+}
+
+/**
+ * @brief Test the pooled (page-based) allocator behind a BST
+ *        - need to detect the SimpleAllocatorExceptions
+ *        - the pages run out, then blocks are reused from the free list
+ *        - debug mode detects bad frees
+ * @param padBytes number of pad bytes around each block
+ */
+void testAllocator(unsigned padBytes) {
+    // print a title of the test
+    cout << "Running testAllocator..." << endl;
+    cout << endl;
+
+    // 2 pages of 4 nodes each with debug checks on
+    // - no header, so double frees are detected by looking in the free list
+    SimpleAllocatorConfig config(false, 4, 2,
+        SimpleAllocatorConfig::HeaderBlockInfo(), 0, padBytes, true);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+
+    {
+        // the BST uses the client's allocator so it fills both pages
+        BST<int> bst(&allocator);
+        addInts<int>(bst, 8, false, true);
+        printAllocatorStats(allocator);
+        cout << endl;
+
+        // and then there are no pages left for another node
+        try {
+            bst.add(8);
+        } catch (BSTException& e) {
+            cout << "  !!! BSTException: " << e.what() << endl;
+        }
+        cout << endl;
+
+        // the removed nodes go back to the free list to be reused
+        removeInts<int>(bst, false, 3, true);
+        printAllocatorStats(allocator);
+        bst.add(8);
+        cout << "Added 8 after removing:" << endl;
+        printBSTStats(bst);
+        printAllocatorStats(allocator);
+        cout << endl;
+    }
+
+    // debug mode catches bad frees
+    char* p = static_cast<char*>(allocator.allocate());
+    void* frees[] = {p + 1, p, p};
+    for (void* pFree : frees) {
+        try {
+            allocator.free(pFree);
+            cout << "  Freed " << (pFree == p ? "block" : "inside block") << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+
+    // overwrite the pad bytes past the end of a block
+    p = static_cast<char*>(allocator.allocate());
+    p[sizeof(BST<int>::BinTreeNode)] = 0;
+    try {
+        allocator.free(p);
+        cout << "  Freed block" << endl;
+    } catch (const SimpleAllocatorException& e) {
+        cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Test moving and swapping BSTs
+ *        - the allocator stats show that no nodes are copied
+ *        - a moved-from tree is empty and can be used again
+ */
+void testMove() {
+    // print a title of the test
+    cout << "Running testMove..." << endl;
+    cout << endl;
+
+    // the trees share a client allocator so that its stats can be shown
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+
+    BST<int> bst1(&allocator);
+    addInts<int>(bst1, 10, false, true);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    cout << "Move constructing BST2 from BST1..." << endl << endl;
+    BST<int> bst2(std::move(bst1));
+    cout << "BST1: ";
+    printBSTStats(bst1);
+    cout << "BST2: ";
+    printBSTStats(bst2);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    cout << "Moving trees into a growing vector..." << endl << endl;
+    std::vector<BST<int>> trees;
+    for (int i = 0; i < 4; ++i) {
+        BST<int> bst(&allocator);
+        bst.add(i);
+        trees.push_back(std::move(bst));
+    }
+    trees.push_back(std::move(bst2));
+    for (const BST<int>& tree : trees)
+        printBSTStats(tree);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    cout << "Move assigning the last tree to the first one..." << endl << endl;
+    trees.front() = std::move(trees.back());
+    printBSTStats(trees.front());
+    printBSTStats(trees.back());
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    cout << "Swapping the first two trees..." << endl << endl;
+    swap(trees[0], trees[1]);
+    printBSTStats(trees[0]);
+    printBSTStats(trees[1]);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    cout << "Reusing moved-from BST1 (it makes its own allocator)..." << endl << endl;
+    addInts<int>(bst1, 5);
+    printAllocatorStats(allocator);
+    cout << endl;
+}
+
+/**
+ * @brief Test adding std::string keys by copy, by move and in place
+ *        - need to detect the BSTExceptions
+ */
+void testEmplace() {
+    // print a title of the test
+    cout << "Running testEmplace..." << endl;
+    cout << endl;
+
+    BST<std::string> bst;
+    std::string kiwi("kiwi");
+    bst.add(kiwi);                       // copied
+    bst.add(std::string("fig"));         // moved
+    bst.emplace("lime");                 // constructed from a const char*
+    bst.emplace(3, 'z');                 // constructed as "zzz"
+    bst.emplace("pear-and-plum", 4);     // constructed from the first 4 chars
+    bst.add("apple");                    // a temporary moved in
+
+    // duplicates are rejected no matter how they are added
+    try {
+        bst.emplace("fig");
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    try {
+        bst.add(std::move(kiwi));
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    cout << "  Value left in kiwi after the failed move: " << kiwi << endl;
+    cout << endl;
+
+    printBSTStats(bst);
+    printBST(bst);
+    testIterators(bst);
+}
+
+/**
+ * @brief Test looking up strings by other key types and a custom order
+ *        - a BST with the transparent std::less<> finds, ranks and removes
+ *          by const char* and std::string_view without making a std::string
+ *        - an AVL with std::greater<int> keeps its values in descending order
+ */
+void testCompare() {
+    // print a title of the test
+    cout << "Running testCompare..." << endl;
+    cout << endl;
+
+    BST<std::string, std::less<>> bst;
+    const char* words[] = {"kiwi", "fig", "lime", "apple", "pear", "zzz"};
+    for (const char* word : words)
+        bst.add(word);
+
+    unsigned compares = 0;
+    bool found = bst.find("lime", compares);
+    cout << "  find(\"lime\"): " << (found ? "found" : "not found")
+         << " after " << compares << " compares" << endl;
+    found = bst.find(std::string_view("grape"), compares);
+    cout << "  find(string_view(\"grape\")): " << (found ? "found" : "not found")
+         << " after " << compares << " compares" << endl;
+    cout << "  rank(\"l\"): " << bst.rank("l") << endl;
+    cout << "  countInRange(\"b\", \"m\"): "
+         << bst.countInRange(std::string_view("b"), std::string_view("m")) << endl;
+    cout << "  lowerBound(\"g\"): " << *bst.lowerBound("g") << endl;
+
+    bst.remove("fig");
+    try {
+        bst.remove(std::string_view("fig"));
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    cout << endl;
+    testIterators(bst);
+
+    AVL<int, std::greater<int>> avl;
+    for (int i = 1; i <= 7; ++i)
+        avl.add(i);
+    cout << "  Descending AVL, height: " << avl.height()
+         << ", [0]: " << avl[0]->data << ", rank(5): " << avl.rank(5) << endl;
+    cout << endl;
+    testIterators(avl);
+}
+
+/**
+ * @brief Test a frozen snapshot of a BST
+ *        - the values are laid out in Eytzinger (BFS) order
+ *        - finds report the compares of the snapshot's complete tree
+ *        - changing the source tree does not change the snapshot
+ * @param bst BST to freeze
+ */
+template <typename T> void testFreeze(BST<T>& bst) {
+    // print a title of the test
+    cout << "Running testFreeze..." << endl;
+    cout << endl;
+
+    FrozenBST<T> frozen = freeze(bst);
+    cout << "  Eytzinger order:";
+    for (const T& value : frozen.data())
+        cout << " " << value;
+    cout << endl;
+
+    // find every value in the tree and the gaps around it
+    bool isFirst = true;
+    for (const T& value : bst) {
+        for (int i = isFirst ? -1 : 0; i <= 1; ++i) {
+            T key = value + i;
+            unsigned compares = 0;
+            bool found = frozen.find(key, compares);
+            const T* lower = frozen.lowerBound(key);
+            cout << "  find(" << key << "): " << (found ? "found" : "not found")
+                 << " after " << compares << " compares, lowerBound: ";
+            if (lower)
+                cout << *lower << endl;
+            else
+                cout << "none" << endl;
+        }
+        isFirst = false;
+    }
+
+    bst.clear();
+    cout << "  Size after clearing the source: " << frozen.size() << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Print the allocator stats that do not depend on how threads interleave
+ * @param allocator allocator to print
+ */
+void printThreadedAllocatorStats(const SimpleAllocator& allocator) {
+    SimpleAllocatorStats stats = allocator.getStats();
+    unsigned blocks = stats.pagesInUse * allocator.getConfig().objectsPerPage;
+    cout << "  in use: " << stats.objectsInUse
+         << ", allocs: " << stats.allocations
+         << ", deallocs: " << stats.deallocations
+         << ", all blocks accounted for: "
+         << (stats.objectsInUse + stats.freeObjects == blocks ? "yes" : "no") << endl;
+}
+
+/**
+ * @brief Test trees built by several threads sharing one allocator
+ *        - each thread allocates from and frees to its own cache
+ *        - the caches of exited threads are taken back by the allocator
+ *        - the stats add up the counts of all the threads
+ */
+void testThreadCache() {
+    // print a title of the test
+    cout << "Running testThreadCache..." << endl;
+    cout << endl;
+
+    // small pages and caches so that the caches refill, flush and run dry
+    SimpleAllocatorConfig config(false, 16, 0, SimpleAllocatorConfig::HeaderBlockInfo(),
+                                 0, 0, false, true, 8);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+
+    // each thread adds 100 values, removes the odd ones and hands its tree back
+    const int threads = 4;
+    std::vector<BST<int>> trees;
+    for (int i = 0; i < threads; ++i)
+        trees.emplace_back(&allocator);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&trees, i]() {
+            for (int j = 0; j < 100; ++j)
+                trees[i].add(i * 1000 + (j * 37) % 100);
+            for (int j = 1; j < 100; j += 2)
+                trees[i].remove(i * 1000 + j);
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    for (int i = 0; i < threads; ++i)
+        cout << "  Tree " << i << ": size " << trees[i].size() << ", first "
+             << *trees[i].begin() << ", last " << *trees[i].rbegin() << endl;
+    printThreadedAllocatorStats(allocator);
+
+    // the main thread frees all the nodes, taking back the exited caches
+    for (BST<int>& tree : trees)
+        tree.clear();
+    printThreadedAllocatorStats(allocator);
+    cout << endl;
+}
+
+/**
+ * @brief Test allocating and freeing blocks in batches
+ *        - a batch that does not fit is all or nothing
+ *        - copying and clearing a tree use the batches
+ *        - freeAll() releases every page at once
+ */
+void testBatch() {
+    // print a title of the test
+    cout << "Running testBatch..." << endl;
+    cout << endl;
+
+    // 2 pages of 4 nodes each
+    SimpleAllocatorConfig config(false, 4, 2);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+
+    // 9 blocks do not fit, so none are handed out
+    void* blocks[9] = {};
+    try {
+        allocator.allocateBatch(9, blocks);
+    } catch (SimpleAllocatorException& e) {
+        cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+    }
+    printAllocatorStats(allocator);
+
+    allocator.allocateBatch(6, blocks);
+    printAllocatorStats(allocator);
+    allocator.freeBatch(blocks, 6);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    // a copy takes its nodes in one batch and clear gives them back in one
+    BST<int> bst(&allocator);
+    for (int value : {4, 2, 6, 1, 3})
+        bst.add(value);
+    printAllocatorStats(allocator);
+    try {
+        BST<int> copy(bst);
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    printAllocatorStats(allocator);
+    bst.remove(1);
+    bst.remove(3);
+    {
+        BST<int> copy(bst);
+        printAllocatorStats(allocator);
+        copy.clear();
+        printAllocatorStats(allocator);
+    }
+    cout << endl;
+
+    // every page goes back at once, as if each block was freed
+    bst.clear();
+    allocator.allocateBatch(5, blocks);
+    allocator.freeAll();
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    // a tree that owns its allocator releases its pages on clear
+    // - values that need destroying are still destroyed first
+    BST<std::string> words;
+    for (const char* word : {"kiwi", "fig", "a-string-too-long-for-sso", "pear"})
+        words.add(word);
+    BST<std::string> copy(words);
+    words.clear();
+    words.add("lime");
+    printBSTStats(words);
+    testIterators(words);
+    testIterators(copy);
+}
+
+/**
+ * @brief Test pages that grow and are released once they are free
+ *        - each new page has twice the blocks of the last, up to a cap
+ *        - pages with no blocks in use are released while too many blocks
+ *          would still be free without them, so the pages follow the
+ *          number of nodes with a margin of a page
+ *        - the debug checks still find the page of a block
+ */
+void testGrowablePages() {
+    // print a title of the test
+    cout << "Running testGrowablePages..." << endl;
+    cout << endl;
+
+    // pages of 2, 4, 8, 8, ... blocks, releasing free pages above 4 free blocks
+    SimpleAllocatorConfig config(false, 2, 0, SimpleAllocatorConfig::HeaderBlockInfo(),
+                                 0, 0, true, false, DEFAULT_THREAD_CACHE_SIZE, 8, 4);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+    BST<int> bst(&allocator);
+
+    for (int i = 1; i <= 20; ++i) {
+        bst.add(i);
+        if (i == 2 || i == 6 || i == 14 || i == 20)
+            printAllocatorStats(allocator);
+    }
+    cout << endl;
+
+    // removing the oldest nodes frees whole pages
+    for (int i = 1; i <= 16; ++i) {
+        bst.remove(i);
+        if (i % 4 == 0)
+            printAllocatorStats(allocator);
+    }
+    cout << endl;
+
+    // and they come back as needed
+    for (int i = 21; i <= 30; ++i)
+        bst.add(i);
+    printAllocatorStats(allocator);
+    printBSTStats(bst);
+    testIterators(bst);
+}
+
+/**
+ * @brief Test allocators with their options chosen at compile time
+ *        - the release policies are a bare free list with no checks
+ *        - the debug policies catch the same bad frees as SimpleAllocator
+ *        - blocks are aligned to the Alignment parameter
+ */
+void testPolicyAllocator() {
+    // print a title of the test
+    cout << "Running testPolicyAllocator..." << endl;
+    cout << endl;
+
+    // release: 2 pages of 4 blocks
+    PolicyAllocator<> release(sizeof(BST<int>::BinTreeNode), 4, 2);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 8; ++i)
+        blocks.push_back(release.allocate());
+    printAllocatorStats(release);
+    try {
+        release.allocate();
+    } catch (const SimpleAllocatorException& e) {
+        cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+    }
+
+    // freed blocks are reused last in, first out
+    release.free(blocks[3]);
+    release.free(blocks[5]);
+    cout << "  Reused freed blocks: " << std::boolalpha
+         << (release.allocate() == blocks[5] && release.allocate() == blocks[3])
+         << std::noboolalpha << endl;
+    for (void* p : blocks)
+        release.free(p);
+    printAllocatorStats(release);
+    cout << endl;
+
+    // debug: basic headers and 4 pad bytes, aligned to 64 bytes
+    PolicyAllocator<DebugCheckPolicy, BasicHeaderPolicy, 4, 64> debug(sizeof(BST<int>::BinTreeNode), 4);
+    bool isAligned = true;
+    blocks.clear();
+    for (int i = 0; i < 6; ++i) {
+        blocks.push_back(debug.allocate());
+        isAligned = isAligned && reinterpret_cast<uintptr_t>(blocks.back()) % 64 == 0;
+    }
+    cout << "  Blocks aligned to 64 bytes: " << std::boolalpha << isAligned
+         << std::noboolalpha << endl;
+    printAllocatorStats(debug);
+
+    // debug mode catches bad frees
+    char* p = static_cast<char*>(blocks[0]);
+    void* frees[] = {p + 1, p, p};
+    for (void* pFree : frees) {
+        try {
+            debug.free(pFree);
+            cout << "  Freed " << (pFree == p ? "block" : "inside block") << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+
+    // overwrite the pad bytes before and past the end of a block
+    char* overruns[] = {static_cast<char*>(blocks[1]) - 1,
+                        static_cast<char*>(blocks[2]) + sizeof(BST<int>::BinTreeNode)};
+    for (int i = 0; i < 2; ++i) {
+        *overruns[i] = 0;
+        try {
+            debug.free(blocks[i + 1]);
+            cout << "  Freed block" << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+    printAllocatorStats(debug);
+
+    // no header: double frees are found by looking in the free list
+    PolicyAllocator<DebugCheckPolicy> noHeader(sizeof(int), 4);
+    p = static_cast<char*>(noHeader.allocate());
+    for (int i = 0; i < 2; ++i) {
+        try {
+            noHeader.free(p);
+            cout << "  Freed block" << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+    printAllocatorStats(noHeader);
+    cout << endl;
+}
+
+/**
+ * @brief Count the nodes of a tree that are not aligned to a boundary
+ * @tparam T type of data stored in the tree
+ * @param tree root of the tree
+ * @param alignment the boundary
+ * @return number of misaligned nodes
+ */
+template <typename T>
+int countMisalignedNodes(typename BST<T>::BinTree tree, uintptr_t alignment) {
+    if (tree == nullptr)
+        return 0;
+    return (reinterpret_cast<uintptr_t>(tree) % alignment != 0) +
+           countMisalignedNodes<T>(tree->left, alignment) +
+           countMisalignedNodes<T>(tree->right, alignment);
+}
+
+/**
+ * @brief Test aligning the blocks of an allocator
+ *        - the align bytes put every object on the boundary, even with
+ *          a header and pad bytes in front of it
+ *        - the pad bytes are still checked in debug mode
+ *        - a BST's own allocator aligns nodes that divide a cache line
+ */
+void testAlignment() {
+    // print a title of the test
+    cout << "Running testAlignment..." << endl;
+    cout << endl;
+
+    // 16-byte boundary with a basic header and 2 pad bytes
+    SimpleAllocatorConfig config(false, 4, 2,
+        SimpleAllocatorConfig::HeaderBlockInfo(SimpleAllocatorConfig::BASIC_HEADER),
+        16, 2, true);
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+    SimpleAllocatorConfig computed = allocator.getConfig();
+    cout << "  left align: " << computed.leftAlignBytesSize
+         << ", inter align: " << computed.interAlignBytesSize
+         << ", page size: " << allocator.getStats().pageSize << endl;
+
+    std::vector<char*> blocks;
+    bool isAligned = true;
+    for (int i = 0; i < 8; ++i) {
+        blocks.push_back(static_cast<char*>(allocator.allocate()));
+        isAligned = isAligned && reinterpret_cast<uintptr_t>(blocks.back()) % 16 == 0;
+    }
+    cout << "  Objects aligned to 16 bytes: " << std::boolalpha << isAligned
+         << std::noboolalpha << endl;
+    printAllocatorStats(allocator);
+
+    // the pad bytes still sit right after the object
+    blocks[0][sizeof(BST<int>::BinTreeNode)] = 0;
+    for (char* p : blocks) {
+        try {
+            allocator.free(p);
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+    printAllocatorStats(allocator);
+
+    // the boundary has to be a power of 2
+    try {
+        SimpleAllocator bad(sizeof(int), SimpleAllocatorConfig(false, 4, 2,
+            SimpleAllocatorConfig::HeaderBlockInfo(), 24));
+    } catch (const SimpleAllocatorException& e) {
+        cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+    }
+    cout << endl;
+
+    // huge pages are filled with as many blocks as fit (the OS may or may
+    // not actually back them with huge pages)
+    SimpleAllocatorConfig hugeConfig(false, 4, 0, SimpleAllocatorConfig::HeaderBlockInfo(),
+                                     64, 0, false, false, DEFAULT_THREAD_CACHE_SIZE, 0, 0,
+                                     true, true);
+    SimpleAllocator huge(sizeof(BST<int>::BinTreeNode), hugeConfig);
+    void* p = huge.allocate();
+    cout << "  Huge page size: " << huge.getStats().pageSize
+         << ", aligned to 64 bytes: " << std::boolalpha
+         << (reinterpret_cast<uintptr_t>(p) % 64 == 0) << std::noboolalpha << endl;
+    printAllocatorStats(huge);
+    huge.free(p);
+    cout << endl;
+
+    // a BST's own allocator keeps each node within a cache line
+    BST<int> bst;
+    for (int i = 0; i < 100; ++i)
+        bst.add((i * 37) % 100);
+    cout << "  BST<int> node size: " << sizeof(BST<int>::BinTreeNode)
+         << ", misaligned nodes: "
+         << countMisalignedNodes<int>(bst.root(), sizeof(BST<int>::BinTreeNode)) << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Test the stats and the profile of an allocator
+ *        - the CPP mem manager keeps the same counts as the pages do
+ *        - a profile buckets the pages by how full they are, and with
+ *          isProfiling counts every call in the latency histograms
+ *        - the profile can be written as JSON
+ */
+void testProfile() {
+    // print a title of the test
+    cout << "Running testProfile..." << endl;
+    cout << endl;
+
+    // the CPP mem manager counts the objects in use and the peak
+    SimpleAllocator cpp(sizeof(int), SimpleAllocatorConfig(true));
+    void* blocks[10];
+    for (int i = 0; i < 3; ++i)
+        blocks[i] = cpp.allocate();
+    cpp.free(blocks[0]);
+    cpp.free(nullptr);
+    printAllocatorStats(cpp);
+    cpp.free(blocks[1]);
+    cpp.free(blocks[2]);
+    printAllocatorStats(cpp);
+    cout << endl;
+
+    // pages of 4 blocks with 2 of the 3 pages half full
+    for (bool isProfiling : {true, false}) {
+        SimpleAllocatorConfig config(false, 4, 0, SimpleAllocatorConfig::HeaderBlockInfo(),
+                                     0, 0, false, false, DEFAULT_THREAD_CACHE_SIZE, 0, 0,
+                                     false, false, isProfiling);
+        SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), config);
+        for (int i = 0; i < 10; ++i)
+            blocks[i] = allocator.allocate();
+        allocator.free(blocks[0]);
+        allocator.free(blocks[1]);
+
+        SimpleAllocatorProfile profile = allocator.getProfile();
+        unsigned long long timedAllocs = 0;
+        unsigned long long timedFrees = 0;
+        for (unsigned i = 0; i < LATENCY_BUCKETS; ++i) {
+            timedAllocs += profile.allocateLatency[i];
+            timedFrees += profile.freeLatency[i];
+        }
+        cout << "  isProfiling: " << std::boolalpha << isProfiling << std::noboolalpha
+             << ", timed allocs: " << timedAllocs << ", timed frees: " << timedFrees << endl;
+        cout << "  page fill:";
+        for (unsigned i = 0; i < PAGE_FILL_BUCKETS; ++i)
+            cout << " " << profile.pageFill[i];
+        cout << ", fragmentation: " << profile.fragmentation << endl;
+
+        // the latencies are machine dependent, so only print the JSON without them
+        if (!isProfiling)
+            cout << "  " << profile.toJson() << endl;
+        for (int i = 2; i < 10; ++i)
+            allocator.free(blocks[i]);
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Test a BST whose nodes link by index
+ *        - it finds, removes and indexes values exactly like a BST
+ *          given the same adds
+ *        - a node is half the size of a BST node
+ *        - a narrow Index caps the number of nodes
+ * @param bst the pointer-based tree with the same adds to compare against
+ */
+void testCompactBST(BST<int>& bst) {
+    // print a title of the test
+    cout << "Running testCompactBST..." << endl;
+    cout << endl;
+
+    cout << "  node size: " << sizeof(CompactBST<int>::Node) << " (BST: "
+         << sizeof(BST<int>::BinTreeNode) << ")" << endl;
+
+    CompactBST<int> compact;
+    Utils::srand(8, 1);
+    for (int i = 0; i < 20; ++i) {
+        int value = Utils::randInt(0, 99);
+        try {
+            bst.add(value);
+            compact.add(value);
+        } catch (const BSTException&) {
+            // the BST throws first, so the compact tree is never reached
+            try {
+                compact.add(value);
+            } catch (const BSTException& e) {
+                cout << "  !!! BSTException: " << e.what() << endl;
+            }
+        }
+    }
+    cout << "  size: " << compact.size() << ", height: " << compact.height()
+         << " (BST: " << bst.size() << ", " << bst.height() << ")" << endl;
+
+    // the same shape gives the same compares
+    unsigned compares = 0;
+    unsigned bstCompares = 0;
+    unsigned found = 0;
+    for (int value = 0; value < 100; ++value) {
+        unsigned n = 0;
+        found += compact.find(value, n);
+        compares += n;
+        bst.find(value, n);
+        bstCompares += n;
+    }
+    cout << "  found: " << found << ", compares: " << compares
+         << " (BST: " << bstCompares << ")" << endl;
+
+    // remove every other value in sorted order
+    for (unsigned i = 0; i < compact.size(); ++i) {
+        int value = *compact[i];
+        compact.remove(value);
+        bst.remove(value);
+    }
+    try {
+        compact.remove(1000);
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    bool isSame = compact.size() == bst.size();
+    cout << "  after removes:";
+    for (unsigned i = 0; i < compact.size(); ++i) {
+        cout << " " << *compact[i];
+        isSame = isSame && *compact[i] == bst[i]->data;
+    }
+    cout << endl << "  same values as BST: " << std::boolalpha << isSame << std::noboolalpha;
+    cout << endl << "  size: " << compact.size() << ", height: " << compact.height()
+         << " (BST: " << bst.size() << ", " << bst.height() << ")" << endl;
+    try {
+        compact[static_cast<int>(compact.size())];
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+
+    // removed nodes are reused before the page grows
+    size_t pageBytes = compact.pageBytes();
+    for (int value = 100; value < 105; ++value)
+        compact.add(value);
+    cout << "  pages grew: " << std::boolalpha << (compact.pageBytes() != pageBytes)
+         << std::noboolalpha << endl;
+    compact.clear();
+    cout << "  cleared: size " << compact.size() << ", page bytes " << compact.pageBytes()
+         << endl;
+
+    // 16-bit indices have room for 65535 nodes
+    // - the odd multiplier adds 0 to 65535 in a scrambled order
+    CompactBST<int, std::less<int>, uint16_t> small;
+    try {
+        for (unsigned i = 0;; ++i)
+            small.add(static_cast<int>(i * 40503 % 65536));
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << " (size " << small.size() << ")"
+             << endl;
+    }
+    cout << endl;
+}
+
+/**
+ * @brief Test arena allocators and trees that own one
+ *        - blocks are handed out in order and only reused after freeAll(),
+ *          which keeps the pages
+ *        - a tree with an arena gives back all its nodes on clear()
+ */
+void testArena() {
+    // print a title of the test
+    cout << "Running testArena..." << endl;
+    cout << endl;
+
+    // pages of 4 blocks
+    SimpleAllocatorConfig config(false, 4, 2);
+    config.isArena = true;
+    SimpleAllocator arena(sizeof(int), config);
+    char* blocks[8];
+    for (int i = 0; i < 6; ++i)
+        blocks[i] = static_cast<char*>(arena.allocate());
+    printAllocatorStats(arena);
+    arena.free(blocks[0]);
+    arena.free(blocks[5]);
+    blocks[6] = static_cast<char*>(arena.allocate());
+    cout << "  Reused a freed block: " << std::boolalpha
+         << (blocks[6] == blocks[0] || blocks[6] == blocks[5])
+         << ", in order: " << (blocks[6] == blocks[5] + (blocks[5] - blocks[4]))
+         << std::noboolalpha << endl;
+    printAllocatorStats(arena);
+
+    // freeAll keeps the pages and starts from the 1st block again
+    arena.freeAll();
+    printAllocatorStats(arena);
+    bool isSameBlocks = true;
+    for (int i = 0; i < 8; ++i)
+        isSameBlocks = isSameBlocks && (arena.allocate() == blocks[i] || i >= 6);
+    cout << "  Same blocks after freeAll: " << std::boolalpha << isSameBlocks
+         << std::noboolalpha << endl;
+    printAllocatorStats(arena);
+    try {
+        arena.allocate();
+    } catch (const SimpleAllocatorException& e) {
+        cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+    }
+
+    // debug checks still run on free
+    SimpleAllocatorConfig debugConfig(false, 4, 1,
+        SimpleAllocatorConfig::HeaderBlockInfo(SimpleAllocatorConfig::BASIC_HEADER),
+        0, 2, true);
+    debugConfig.isArena = true;
+    SimpleAllocator debugArena(sizeof(int), debugConfig);
+    void* p = debugArena.allocate();
+    for (int i = 0; i < 2; ++i) {
+        try {
+            debugArena.free(p);
+            cout << "  Freed block" << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+
+    // without a header, the freed pattern marks freed blocks, and blocks
+    // after the last one handed out cannot be freed yet
+    debugConfig.headerBlockInfo = SimpleAllocatorConfig::HeaderBlockInfo();
+    SimpleAllocator plainArena(sizeof(int), debugConfig);
+    char* pFirst = static_cast<char*>(plainArena.allocate());
+    char* pSecond = static_cast<char*>(plainArena.allocate());
+    void* frees[] = {pFirst, pFirst, pSecond + (pSecond - pFirst)};
+    for (void* pFree : frees) {
+        try {
+            plainArena.free(pFree);
+            cout << "  Freed block" << endl;
+        } catch (const SimpleAllocatorException& e) {
+            cout << "  !!! SimpleAllocatorException: " << e.what() << endl;
+        }
+    }
+    cout << endl;
+
+    // a tree of strings in an arena destroys its values but does not free
+    // its nodes one by one
+    BST<std::string> words(BST<std::string>::arenaConfig());
+    for (const char* word : {"pear", "apple", "fig", "kiwi", "plum", "date"})
+        words.add(word);
+    words.remove("fig");
+    words.remove("pear");
+    words.add("lime");
+    cout << "  words:";
+    for (const std::string& word : words)
+        cout << " " << word;
+    cout << endl;
+    words.clear();
+    words.add("mango");
+    cout << "  after clear: " << words.size() << " word, " << words[0]->data << endl;
+
+    // an AVL in an arena copies into an arena too
+    AVL<int> avl(AVL<int>::arenaConfig());
+    for (int i = 0; i < 2000; ++i)
+        avl.add(i);
+    for (int i = 0; i < 2000; i += 2)
+        avl.remove(i);
+    AVL<int> copy(avl);
+    cout << "  avl: size " << avl.size() << ", height " << avl.height()
+         << ", copy: size " << copy.size() << ", height " << copy.height() << endl;
+    avl.clear();
+    cout << "  after clear: size " << avl.size() << ", copy size " << copy.size() << endl;
+    cout << endl;
+}
+
+/**
+ * @brief An int ordering that holds each thread back on its first compare
+ *        until the gate opens, so that readers can be kept mid-find
+ */
+struct GatedLess {
+    // the gate, and the number of threads held back at it
+    static std::atomic<bool> isOpen;
+    static std::atomic<int> waiting;
+
+    // whether this thread has been through the gate (or need not wait)
+    static thread_local bool isThrough;
+
+    bool operator()(int lhs, int rhs) const {
+        if (!isThrough) {
+            isThrough = true;
+            ++waiting;
+            while (!isOpen)
+                std::this_thread::yield();
+        }
+        return lhs < rhs;
+    }
+};
+std::atomic<bool> GatedLess::isOpen(false);
+std::atomic<int> GatedLess::waiting(0);
+thread_local bool GatedLess::isThrough = false;
+
+/**
+ * @brief Test a BST that threads read while another thread updates it
+ *        - adds, removes, finds and subscripts match a BST
+ *        - readers always find the values the writer leaves alone, and never
+ *          see a half-done update of the others
+ *        - more readers than there are reader slots get in at once, and keep
+ *          the version they started on while the writer reclaims
+ */
+void testConcurrentBST(BST<int>& bst) {
+    // print a title of the test
+    cout << "Running testConcurrentBST..." << endl;
+    cout << endl;
+
+    ConcurrentBST<int> tree;
+    Utils::srand(8, 1);
+    for (int i = 0; i < 20; ++i) {
+        int value = Utils::randInt(0, 99);
+        try {
+            bst.add(value);
+            tree.add(value);
+        } catch (const BSTException&) {
+            // the BST throws first, so the concurrent tree is never reached
+            try {
+                tree.add(value);
+            } catch (const BSTException& e) {
+                cout << "  !!! BSTException: " << e.what() << endl;
+            }
+        }
+    }
+    cout << "  size: " << tree.size() << ", height: " << tree.height()
+         << " (BST: " << bst.size() << ", " << bst.height() << ")" << endl;
+
+    // remove every other value in sorted order, which copies the paths
+    for (unsigned i = 0; i < tree.size(); ++i) {
+        int value = tree[i];
+        tree.remove(value);
+        bst.remove(value);
+    }
+    try {
+        tree.remove(1000);
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    try {
+        tree[static_cast<int>(tree.size())];
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    bool isSame = tree.size() == bst.size();
+    cout << "  after removes:";
+    for (unsigned i = 0; i < tree.size(); ++i) {
+        cout << " " << tree[i];
+        isSame = isSame && tree[i] == bst[i]->data;
+    }
+    unsigned compares = 0;
+    unsigned bstCompares = 0;
+    for (int value = 0; value < 100; ++value) {
+        unsigned n = 0;
+        tree.find(value, n);
+        compares += n;
+        bst.find(value, n);
+        bstCompares += n;
+    }
+    cout << endl << "  same values as BST: " << std::boolalpha << isSame << std::noboolalpha
+         << ", compares: " << compares << " (BST: " << bstCompares << ")" << endl;
+
+    // the writer adds and removes the odd values while the readers look for
+    // the even ones, which are always there, and check the size stays in range
+    ConcurrentBST<int> shared;
+    for (int value = 0; value < 200; value += 2)
+        shared.add(value);
+    const int readers = 3;
+    std::atomic<bool> isDone(false);
+    std::atomic<unsigned> missed(0);
+    std::atomic<unsigned> badSizes(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < readers; ++i) {
+        workers.emplace_back([&]() {
+            do {
+                for (int value = 0; value < 200; value += 2) {
+                    unsigned n = 0;
+                    if (!shared.find(value, n))
+                        ++missed;
+                }
+                unsigned size = shared.size();
+                if (size < 100 || size > 200 || shared[0] != 0)
+                    ++badSizes;
+            } while (!isDone);
+        });
+    }
+    for (int round = 0; round < 20; ++round) {
+        for (int value = 1; value < 200; value += 2)
+            shared.add(value);
+        for (int value = 1; value < 200; value += 2)
+            shared.remove(value);
+    }
+    isDone = true;
+    for (std::thread& worker : workers)
+        worker.join();
+    cout << "  " << readers << " readers: missed " << missed << ", bad sizes " << badSizes
+         << ", size " << shared.size() << ", height " << shared.height() << endl;
+
+    // more readers than slots are held back mid-find, each looking for a
+    // value the writer then removes (retiring enough nodes to reclaim)
+    // - they still find it, as the version they started on is kept
+    const int heldReaders = static_cast<int>(CONCURRENT_BST_READER_SLOTS) + 36;
+    GatedLess::isThrough = true;
+    ConcurrentBST<int, GatedLess> gated;
+    for (int i = 0; i < 600; ++i)
+        gated.add(i * 7 % 600);
+    std::atomic<int> found(0);
+    workers.clear();
+    for (int i = 0; i < heldReaders; ++i) {
+        workers.emplace_back([&, i]() {
+            unsigned n = 0;
+            if (gated.find(300 + i * 3, n))
+                ++found;
+        });
+    }
+    while (GatedLess::waiting < heldReaders)
+        std::this_thread::yield();
+    for (int value = 300; value < 600; ++value)
+        gated.remove(value);
+    GatedLess::isOpen = true;
+    for (std::thread& worker : workers)
+        worker.join();
+    cout << "  " << heldReaders << " readers held back: found " << found
+         << ", size " << gated.size() << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Test a BST that many threads add to and remove from at once
+ *        - adds, removes, finds and subscripts match a BST
+ *        - removed nodes stay in place and come back when added again, until
+ *          compact() frees them
+ *        - threads adding and removing disjoint values leave the values
+ *          in order with the right counts
+ */
+void testMultiWriterBST(BST<int>& bst) {
+    // print a title of the test
+    cout << "Running testMultiWriterBST..." << endl;
+    cout << endl;
+
+    MultiWriterBST<int> tree;
+    Utils::srand(8, 1);
+    for (int i = 0; i < 20; ++i) {
+        int value = Utils::randInt(0, 99);
+        try {
+            bst.add(value);
+            tree.add(value);
+        } catch (const BSTException&) {
+            // the BST throws first, so the multi-writer tree is never reached
+            try {
+                tree.add(value);
+            } catch (const BSTException& e) {
+                cout << "  !!! BSTException: " << e.what() << endl;
+            }
+        }
+    }
+    cout << "  size: " << tree.size() << ", height: " << tree.height()
+         << " (BST: " << bst.size() << ", " << bst.height() << ")" << endl;
+
+    // remove every other value in sorted order, which leaves their nodes
+    int removed = *tree[0];
+    for (unsigned i = 0; i < tree.size(); ++i) {
+        int value = *tree[i];
+        tree.remove(value);
+        bst.remove(value);
+    }
+    try {
+        tree.remove(removed);
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    try {
+        tree[static_cast<int>(tree.size())];
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    bool isSame = tree.size() == bst.size();
+    cout << "  after removes:";
+    for (unsigned i = 0; i < tree.size(); ++i) {
+        cout << " " << *tree[i];
+        isSame = isSame && *tree[i] == bst[i]->data;
+    }
+    unsigned found = 0;
+    for (int value = 0; value < 100; ++value) {
+        unsigned n = 0;
+        found += tree.find(value, n);
+    }
+    cout << endl << "  same values as BST: " << std::boolalpha << isSame << std::noboolalpha
+         << ", found: " << found << ", removed nodes: " << tree.removedNodes()
+         << ", height: " << tree.height() << endl;
+
+    // adding a removed value brings its node back
+    tree.add(removed);
+    cout << "  added " << removed << " again: size " << tree.size() << ", removed nodes "
+         << tree.removedNodes() << ", first " << *tree[0] << endl;
+
+    // compacting frees the removed nodes and balances the rest
+    tree.compact();
+    cout << "  after compact:";
+    for (unsigned i = 0; i < tree.size(); ++i)
+        cout << " " << *tree[i];
+    cout << " (size " << tree.size() << ", removed nodes " << tree.removedNodes()
+         << ", height " << tree.height() << ")" << endl;
+    cout << endl;
+
+    // each thread adds its own values in a scrambled order and removes half
+    // - the odd multiplier maps 0 to 65535 onto itself
+    MultiWriterBST<int> shared;
+    const int threads = 4;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&shared, t]() {
+            for (unsigned i = t; i < 65536; i += threads)
+                shared.add(static_cast<int>(i * 40503 % 65536));
+            for (unsigned i = t; i < 65536; i += 2 * threads)
+                shared.remove(static_cast<int>(i * 40503 % 65536));
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+
+    bool isSorted = true;
+    unsigned missing = 0;
+    for (unsigned i = 0; i < shared.size(); ++i) {
+        unsigned n = 0;
+        isSorted = isSorted && (i == 0 || *shared[i - 1] < *shared[i]);
+        missing += !shared.find(*shared[i], n);
+    }
+    cout << "  " << threads << " writers: size " << shared.size() << ", removed nodes "
+         << shared.removedNodes() << ", sorted " << std::boolalpha << isSorted
+         << std::noboolalpha << ", missing " << missing << endl;
+    shared.compact();
+    shared.add(-1);
+    cout << "  after compact and add: size " << shared.size() << ", removed nodes "
+         << shared.removedNodes() << ", height " << shared.height() << ", first "
+         << *shared[0] << ", last " << *shared[shared.size() - 1] << endl;
+    shared.clear();
+    cout << "  after clear: size " << shared.size() << ", height " << shared.height() << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Print the values, size and height of a tree on one line
+ * @param label what the tree is
+ * @param bst the tree to print
+ */
+template <typename T>
+void printSplitTree(const std::string& label, const BST<T>& bst) {
+    cout << "  " << label << ":";
+    for (const T& value : bst)
+        cout << " " << value;
+    cout << " (size " << bst.size() << ", height " << bst.height() << ")" << endl;
+}
+
+/**
+ * @brief Test splitting trees at a value and joining them back
+ *        - the halves keep their counts (and heights) so operator[] works
+ *        - the halves keep the nodes and the allocator of the tree split
+ *        - trees with their own allocators can still be joined
+ */
+void testSplitJoin(BST<int>& bst) {
+    // print a title of the test
+    cout << "Running testSplitJoin..." << endl;
+    cout << endl;
+
+    AVL<int> avl;
+    for (int i = 0; i < 20; ++i)
+        avl.add(i * 7 % 20);
+    std::pair<AVL<int>, AVL<int>> halves = avl.split(13);
+    printSplitTree("avl after split at 13", avl);
+    printSplitTree("lower", halves.first);
+    printSplitTree("upper", halves.second);
+    cout << "  lower[5]: " << halves.first[5]->data << ", upper[5]: "
+         << halves.second[5]->data << endl;
+
+    // the halves stay balanced as they change
+    for (int i = 20; i < 30; ++i)
+        halves.second.add(i);
+    halves.first.remove(0);
+    printSplitTree("upper + 20..29", halves.second);
+
+    AVL<int> joined = AVL<int>::join(std::move(halves.first), std::move(halves.second));
+    printSplitTree("joined", joined);
+    cout << "  joined[12]: " << joined[12]->data << endl;
+    try {
+        AVL<int> more;
+        more.add(5);
+        joined = AVL<int>::join(std::move(joined), std::move(more));
+    } catch (const BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+
+    // splitting below and above every value gives an empty half
+    halves = joined.split(-1);
+    printSplitTree("split at -1, lower", halves.first);
+    halves = halves.second.split(100);
+    printSplitTree("split at 100, upper", halves.second);
+    cout << endl;
+
+    // the halves still hold the allocator after the tree split goes away,
+    // and trees with different allocators are joined by copying one over
+    std::pair<AVL<int>, AVL<int>> parts = []() {
+        AVL<int> sorted;
+        for (int i = 0; i < 100; ++i)
+            sorted.add(i);
+        return sorted.split(64);
+    }();
+    AVL<int> high;
+    for (int i = 100; i < 110; ++i)
+        high.add(i);
+    AVL<int> all = AVL<int>::join(std::move(parts.second), std::move(high));
+    all = AVL<int>::join(std::move(parts.first), std::move(all));
+    cout << "  rejoined 0..109: size " << all.size() << ", height " << all.height()
+         << ", all[64]: " << all[64]->data << ", all[109]: " << all[109]->data << endl;
+
+    // a plain BST splits along its shape, without rebalancing
+    for (int value : {50, 30, 70, 20, 40, 60, 80, 35, 45})
+        bst.add(value);
+    std::pair<BST<int>, BST<int>> sides = bst.split(42);
+    printSplitTree("bst split at 42, lower", sides.first);
+    printSplitTree("upper", sides.second);
+    BST<int> whole = BST<int>::join(std::move(sides.first), std::move(sides.second));
+    printSplitTree("joined", whole);
+    cout << endl;
+}
+
+/**
+ * @brief Test the set operations between two trees
+ *        - values in both trees do not throw
+ *        - the results are height-optimal, so an AVL stays valid
+ *        - more threads give the same result
+ */
+void testSetOperations(BST<int>& bst) {
+    // print a title of the test
+    cout << "Running testSetOperations..." << endl;
+    cout << endl;
+
+    // multiples of 2 and of 3 below 30, added in a scrambled order
+    BST<int> twos;
+    BST<int> threes;
+    for (int i = 0; i < 15; ++i) {
+        bst.add(i * 7 % 15 * 2);
+        if (i < 10)
+            threes.add(i * 3 % 10 * 3);
+    }
+    twos = bst;
+    printSplitTree("twos", twos);
+    printSplitTree("threes", threes);
+
+    BST<int> both = twos;
+    both.unionWith(threes);
+    printSplitTree("union", both);
+    cout << "  union[10]: " << both[10]->data << endl;
+    both = twos;
+    both.intersectWith(threes);
+    printSplitTree("intersection", both);
+    both = twos;
+    both.subtract(threes);
+    printSplitTree("twos - threes", both);
+    both.subtract(both);
+    printSplitTree("minus itself", both);
+    both.unionWith(threes);
+    printSplitTree("empty + threes", both);
+    cout << endl;
+
+    // an AVL stays balanced and can carry on changing
+    AVL<int> avl;
+    for (int i = 0; i < 100; ++i)
+        avl.add(i);
+    AVL<int> odds;
+    for (int i = 1; i < 200; i += 2)
+        odds.add(i);
+    avl.unionWith(odds);
+    cout << "  avl 0..99 + odd 1..199: size " << avl.size() << ", height " << avl.height()
+         << ", avl[120]: " << avl[120]->data << endl;
+    for (int i = 200; i < 300; ++i)
+        avl.add(i);
+    avl.subtract(odds);
+    cout << "  + 200..299 - odds: size " << avl.size() << ", height " << avl.height()
+         << ", avl[49]: " << avl[49]->data << ", avl[50]: " << avl[50]->data << endl;
+
+    // the subtrees are only handed out above a cutoff, so use big trees
+    std::vector<int> evens;
+    std::vector<int> fives;
+    for (int i = 0; i < 200000; ++i) {
+        evens.push_back(2 * i);
+        fives.push_back(5 * i);
+    }
+    BST<int> serial(evens.begin(), evens.end());
+    BST<int> parallel(evens.begin(), evens.end());
+    BST<int> other(fives.begin(), fives.end());
+    serial.intersectWith(other);
+    parallel.intersectWith(other, 4);
+    bool isSame = serial.size() == parallel.size() &&
+                  std::equal(serial.begin(), serial.end(), parallel.begin());
+    cout << "  evens & fives: size " << serial.size() << ", height " << serial.height()
+         << ", same with 4 threads: " << std::boolalpha << isSame << std::noboolalpha
+         << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Test adding and removing without exceptions
+ *        - duplicates and misses are reported by the return value
+ *        - a duplicate or a miss does not allocate (or free) a node
+ *        - an AVL still rebalances and a transparent key can be removed
+ *        - the throwing add() and remove() still throw
+ */
+void testTryAddRemove() {
+    // print a title of the test
+    cout << "Running testTryAddRemove..." << endl;
+    cout << endl;
+
+    SimpleAllocator allocator(sizeof(BST<int>::BinTreeNode), SimpleAllocatorConfig());
+    BST<int> bst(&allocator);
+    cout << "  tryAdd:";
+    for (int i = 0; i < 10; ++i) {
+        int value = i * 7 % 5 * 10;
+        cout << " " << value << (bst.tryAdd(value) ? "+" : "=");
+    }
+    cout << endl;
+    printSplitTree("bst", bst);
+    printAllocatorStats(allocator);
+
+    cout << "  tryRemove:";
+    for (int value : {20, 25, 20, 0})
+        cout << " " << value << (bst.tryRemove(value) ? "-" : "?");
+    cout << endl;
+    printSplitTree("bst", bst);
+    printAllocatorStats(allocator);
+    cout << endl;
+
+    // the throwing API is unchanged
+    try {
+        bst.add(10);
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    try {
+        bst.remove(20);
+    } catch (BSTException& e) {
+        cout << "  !!! BSTException: " << e.what() << endl;
+    }
+    cout << endl;
+
+    // an AVL rebalances on the way back up as it does for add()
+    AVL<int> avl;
+    unsigned added = 0;
+    for (int i = 0; i < 200; ++i)
+        added += avl.tryAdd(i / 2);
+    cout << "  avl after 200 tryAdds of 0..99 twice: added " << added << ", size " << avl.size()
+         << ", height " << avl.height() << endl;
+    unsigned removed = 0;
+    for (int i = 0; i < 100; i += 2)
+        removed += avl.tryRemove(i) + avl.tryRemove(i);
+    cout << "  after tryRemoving the evens twice: removed " << removed << ", size "
+         << avl.size() << ", height " << avl.height() << ", avl[10]: " << avl[10]->data << endl;
+
+    // a string moved into tryAdd is left as is when it is a duplicate
+    BST<std::string, std::less<>> words;
+    std::string word = "fig";
+    words.tryAdd(std::move(word));
+    word = "fig";
+    bool isAdded = words.tryAdd(std::move(word));
+    cout << "  tryAdd(move(\"fig\")) again: " << std::boolalpha << isAdded
+         << ", word left as \"" << word << "\"" << endl;
+    isAdded = words.tryRemove(std::string_view("fig"));
+    cout << "  tryRemove(string_view(\"fig\")): " << isAdded
+         << ", then: " << words.tryRemove("fig") << std::noboolalpha << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Test copying big trees with more than one thread
+ *        - the copies have the same values, shape and counts
+ *        - a lopsided tree is copied the same way
+ *        - a copy that throws part way frees every node it made
+ */
+void testParallelCopy() {
+    // print a title of the test
+    cout << "Running testParallelCopy..." << endl;
+    cout << endl;
+
+    // big enough for subtrees to be handed to other threads
+    std::vector<int> values(300000);
+    for (int i = 0; i < 300000; ++i)
+        values[i] = 2 * i;
+    BST<int> bst(values.begin(), values.end());
+    for (unsigned threads : {1u, 2u, 3u, 8u}) {
+        BST<int> copy(bst, threads);
+        bool isSame = std::equal(copy.begin(), copy.end(), bst.begin(), bst.end());
+        cout << "  copy with " << threads << " threads: same " << std::boolalpha << isSame
+             << std::noboolalpha << ", size " << copy.size() << ", height " << copy.height()
+             << ", copy[123456]: " << copy[123456]->data << endl;
+    }
+
+    // a plain join makes the smallest right value the root, so the left
+    // subtree is tiny and the right one holds almost everything
+    std::vector<int> negatives;
+    for (int i = -10; i < 0; ++i)
+        negatives.push_back(i);
+    BST<int> lopsided = BST<int>::join(BST<int>(negatives.begin(), negatives.end()),
+                                       BST<int>(bst));
+    cout << "  lopsided root: " << lopsided.root()->data << ", left size "
+         << lopsided.root()->left->count << ", right size "
+         << lopsided.root()->right->count << endl;
+    BST<int> target;
+    target.add(1);
+    target.assign(lopsided, 4);
+    bool isSame = std::equal(target.begin(), target.end(), lopsided.begin(), lopsided.end());
+    cout << "  assigned with 4 threads: same " << std::boolalpha << isSame
+         << std::noboolalpha << ", size " << target.size() << ", height "
+         << target.height() << ", target[10]: " << target[10]->data << endl;
+    cout << endl;
+
+    // copying a value throws part way through the copy
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+    SimpleAllocator allocator(sizeof(BST<CopyLimited>::BinTreeNode), config);
+    std::vector<CopyLimited> limited(values.begin(), values.end());
+    CopyLimited::copiesLeft = 300000;
+    BST<CopyLimited> source(limited.begin(), limited.end(), &allocator);
+    cout << "  source in use: " << allocator.getStats().objectsInUse << endl;
+    CopyLimited::copiesLeft = 200000;
+    try {
+        BST<CopyLimited> copy(source, 4);
+    } catch (std::runtime_error& e) {
+        cout << "  !!! std::runtime_error: " << e.what() << endl;
+    }
+    cout << "  in use after the failed copy: " << allocator.getStats().objectsInUse << endl;
+    cout << endl;
+}
+
+/**
+ * @brief Print the values of a persistent tree on one line, with its size
+ *        and the nodes in use by all trees sharing its allocator
+ * @param label what the tree is
+ * @param tree the tree to print
+ * @param allocator the allocator of the tree
+ */
+void printPersistentTree(const std::string& label, const PersistentBST<int>& tree,
+                         const SimpleAllocator& allocator) {
+    cout << "  " << label << ":";
+    for (unsigned i = 0; i < tree.size(); ++i)
+        cout << " " << tree[i];
+    cout << " (size " << tree.size() << ", nodes in use "
+         << allocator.getStats().objectsInUse << ")" << endl;
+}
+
+/**
+ * @brief Test snapshots that share their nodes with the tree
+ *        - a snapshot costs no nodes until the tree changes
+ *        - a change copies only the shared nodes on its path
+ *        - the tree and its snapshots do not see each other's changes
+ *        - nodes are freed once no tree shares them
+ */
+void testPersistentBST() {
+    // print a title of the test
+    cout << "Running testPersistentBST..." << endl;
+    cout << endl;
+
+    SimpleAllocatorConfig config(false, BST_OBJECTS_PER_PAGE, BST_MAX_PAGES);
+    SimpleAllocator allocator(sizeof(PersistentBST<int>::Node), config);
+    {
+        PersistentBST<int> tree(&allocator);
+        for (int value : {50, 30, 70, 20, 40, 60, 80, 35, 45})
+            tree.add(value);
+        printPersistentTree("tree", tree, allocator);
+
+        // without snapshots the nodes are changed in place
+        tree.remove(35);
+        tree.add(35);
+        printPersistentTree("removed and added 35", tree, allocator);
+
+        // a snapshot shares every node, and a change copies its path
+        PersistentBST<int> before = tree.snapshot();
+        printPersistentTree("snapshot", before, allocator);
+        tree.add(47);
+        printPersistentTree("tree + 47 (copies 50, 30, 40, 45)", tree, allocator);
+        tree.add(43);
+        printPersistentTree("tree + 43 (already copied)", tree, allocator);
+        tree.remove(30);
+        printPersistentTree("tree - 30 (20 takes its place)", tree, allocator);
+        printPersistentTree("snapshot", before, allocator);
+        cout << "  snapshot height " << before.height() << ", tree height "
+             << tree.height() << endl;
+
+        // snapshots can be changed too without touching the tree
+        PersistentBST<int> other = before;
+        other.remove(50);
+        other.add(90);
+        printPersistentTree("copy of snapshot - 50 + 90", other, allocator);
+        printPersistentTree("tree", tree, allocator);
+
+        // duplicates and misses do not copy anything
+        unsigned compares = 0;
+        cout << "  tryAdd(47): " << std::boolalpha << tree.tryAdd(47) << ", tryRemove(30): "
+             << tree.tryRemove(30) << ", find(30) in snapshot: " << before.find(30, compares)
+             << std::noboolalpha << " after " << compares << " compares" << endl;
+        try {
+            tree.add(50);
+        } catch (BSTException& e) {
+            cout << "  !!! BSTException: " << e.what() << endl;
+        }
+        try {
+            other.remove(50);
+        } catch (BSTException& e) {
+            cout << "  !!! BSTException: " << e.what() << endl;
+        }
+        try {
+            before[9];
+        } catch (BSTException& e) {
+            cout << "  !!! BSTException: " << e.what() << endl;
+        }
+
+        // letting go of the snapshots frees the nodes only they had
+        before.clear();
+        other = tree;
+        printPersistentTree("tree after the snapshots went", tree, allocator);
+        other.clear();
+        tree = PersistentBST<int>(&allocator);
+        printPersistentTree("tree after it was replaced", tree, allocator);
+    }
+    cout << "  nodes in use after all trees went: " << allocator.getStats().objectsInUse
+         << endl;
+    cout << endl;
+}
+
 /**
  * The main function
  * @param argc number of command line arguments
  * @param argv array of command line arguments
- * TODO alignmentTest next time. Yes we do not have a test for alignment
- *      so students do not really need to implement alignment in order
- *      to pass the current tests. But it is still a recommended feature.
- *      Students are also encouraged to write their own tests.
+ * Students are encouraged to write their own tests.
  */
 int main(int argc, char* argv[]) {
     // test number
@@ -641,6 +2322,7 @@ int main(int argc, char* argv[]) {
     // same bst inits across all tests
     BST<int> bst = createBST<int>();
     BST<char> charBST = createBST<char>();
+    AVL<int> avl;
 
     // run the test
     switch (test) {
@@ -705,6 +2387,122 @@ int main(int argc, char* argv[]) {
         //timeTaken = clock() - start;
         //cout << endl <<  "Time taken: " << timeTaken << "ms" << endl; 
         break;
+    case 11:
+        cout << "=== Test sorted adds and random removes on an AVL ===" << endl;
+        addInts<int>(avl, 20, true);
+        removeInts<int>(avl, false, 6);
+        testSubscript(avl, 0);
+        testSubscript(avl, 7);
+        testSubscript(avl, 13);
+        break;
+    case 12:
+        cout << "=== Test the pooled allocator behind a BST ===" << endl;
+        testAllocator(8);
+        break;
+    case 13:
+        cout << "=== Test building a BST from sorted ints ===" << endl;
+        testBuild<int>(bst, 20);
+        testSubscript(bst, 13);
+        break;
+    case 14:
+        cout << "=== Test iterating over a BST and an AVL ===" << endl;
+        testIterators(bst);
+        addInts<int>(bst, 12);
+        testIterators(bst);
+        addChars<char>(charBST, 10, true);
+        testIterators(charBST);
+        addInts<int>(avl, 12, true, true);
+        testIterators(avl);
+        break;
+    case 15:
+        cout << "=== Test rank and range queries on a BST ===" << endl;
+        addInts<int>(bst, 20);
+        removeInts<int>(bst, false, 8, true);
+        testIterators(bst);
+        testRange(bst, 4, 14);
+        testRange(bst, 5, 5);
+        testRange(bst, -5, 3);
+        testRange(bst, 18, 30);
+        testRange(bst, 9, 2);
+        break;
+    case 16:
+        cout << "=== Test BST move and swap ===" << endl;
+        testMove();
+        break;
+    case 17:
+        cout << "=== Test adding strings by copy, move and emplace ===" << endl;
+        testEmplace();
+        break;
+    case 18:
+        cout << "=== Test a transparent and a custom comparator ===" << endl;
+        testCompare();
+        break;
+    case 19:
+        cout << "=== Test freezing a BST into an Eytzinger snapshot ===" << endl;
+        for (int value : {10, 20, 30, 40, 50, 60, 70, 80, 90, 100})
+            bst.add(value);
+        testFreeze(bst);
+        break;
+    case 20:
+        cout << "=== Test sharing an allocator between threads ===" << endl;
+        testThreadCache();
+        break;
+    case 21:
+        cout << "=== Test allocating and freeing in batches ===" << endl;
+        testBatch();
+        break;
+    case 22:
+        cout << "=== Test growing and releasing pages ===" << endl;
+        testGrowablePages();
+        break;
+    case 23:
+        cout << "=== Test allocators with compile-time policies ===" << endl;
+        testPolicyAllocator();
+        break;
+    case 24:
+        cout << "=== Test aligning allocator blocks ===" << endl;
+        testAlignment();
+        break;
+    case 25:
+        cout << "=== Test allocator stats and profiles ===" << endl;
+        testProfile();
+        break;
+    case 26:
+        cout << "=== Test a BST with 32-bit node indices ===" << endl;
+        testCompactBST(bst);
+        break;
+    case 27:
+        cout << "=== Test arena allocators and trees ===" << endl;
+        testArena();
+        break;
+    case 28:
+        cout << "=== Test reading a BST while another thread updates it ===" << endl;
+        testConcurrentBST(bst);
+        break;
+    case 29:
+        cout << "=== Test adding to and removing from a BST on many threads ===" << endl;
+        testMultiWriterBST(bst);
+        break;
+    case 30:
+        cout << "=== Test splitting and joining BSTs and AVLs ===" << endl;
+        testSplitJoin(bst);
+        break;
+    case 31:
+        cout << "=== Test union, intersection and difference of BSTs ===" << endl;
+        testSetOperations(bst);
+        break;
+    case 32:
+        cout << "=== Test adding and removing without exceptions ===" << endl;
+        testTryAddRemove();
+        break;
+    case 33:
+        cout << "=== Test copying big trees with more than one thread ===" << endl;
+        testParallelCopy();
+        break;
+    case 34:
+        cout << "=== Test snapshots that share nodes with the tree ===" << endl;
+        testPersistentBST();
+        break;
     default:
         cout << "Please select a valid test." << endl;
         break;